@@ -0,0 +1,151 @@
+/*
+  Copyright 2016 James Hunt <james@jameshunt.us>
+
+  This file is part of libvigor.
+
+  libvigor is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libvigor is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libvigor.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  cache_t eviction policy benchmark
+
+  Replays a trace of cache keys against cache_t, once for each
+  eviction policy and cache size, treating every key as a lookup
+  that (on a miss) is followed by an insert, and reports the hit
+  ratio and throughput of each run.
+
+  With no arguments, a synthetic trace is used: Zipf-distributed
+  requests over NKEYS keys, with a full sweep over SCAN_KEYS keys
+  that are never seen again after every SCAN_EVERY requests (i.e.
+  a nightly backup, or a crawler).  Otherwise, the trace is read
+  from the named file, one key per line.
+ */
+
+#include <vigor.h>
+#include <string.h>
+#include <math.h>
+
+#define NKEYS      100000
+#define NREQS      2000000
+#define ZIPF_S     0.99
+#define SCAN_EVERY 200000
+#define SCAN_KEYS  50000
+#define KEYLEN     24
+
+static char   *KEYS;
+static size_t  NTRACE;
+static char  **TRACE;
+
+static inline uint64_t xorshift(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+static void synthetic_trace(void)
+{
+	double *cdf = vcalloc(NKEYS, sizeof(double));
+	double sum = 0.0;
+	uint64_t rng = 0x9e3779b97f4a7c15ull;
+	size_t i, j, nscan = 0, scans = NREQS / SCAN_EVERY;
+
+	KEYS = vcalloc(NKEYS + scans * SCAN_KEYS, KEYLEN);
+	for (i = 0; i < NKEYS + scans * SCAN_KEYS; i++)
+		snprintf(KEYS + i * KEYLEN, KEYLEN, "key:%lu", i);
+
+	for (i = 0; i < NKEYS; i++)
+		cdf[i] = sum += 1.0 / pow(i + 1, ZIPF_S);
+
+	TRACE = vcalloc(NREQS + scans * SCAN_KEYS, sizeof(char *));
+	for (i = 0; i < NREQS; i++) {
+		if (i && i % SCAN_EVERY == 0)
+			for (j = 0; j < SCAN_KEYS; j++)
+				TRACE[NTRACE++] = KEYS + (NKEYS + nscan++) * KEYLEN;
+
+		double u = (xorshift(&rng) >> 11) * (1.0 / 9007199254740992.0) * sum;
+		size_t lo = 0, hi = NKEYS - 1;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (cdf[mid] < u) lo = mid + 1;
+			else              hi = mid;
+		}
+		TRACE[NTRACE++] = KEYS + lo * KEYLEN;
+	}
+	free(cdf);
+}
+
+static int file_trace(const char *file)
+{
+	FILE *io = fopen(file, "r");
+	char line[1024];
+	size_t cap = 0;
+
+	if (!io) {
+		perror(file);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), io)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (NTRACE == cap) {
+			cap = cap ? cap * 2 : 65536;
+			TRACE = realloc(TRACE, cap * sizeof(char *));
+		}
+		TRACE[NTRACE++] = strdup(line);
+	}
+	fclose(io);
+	return 0;
+}
+
+static void replay(const char *name, int policy, size_t size)
+{
+	cache_t *cc = cache_new(size, 86400);
+	stopwatch_t t;
+	uint64_t ms = 0;
+	size_t i, hits = 0;
+
+	cache_setopt(cc, VIGOR_CACHE_EVICTION, &policy);
+	STOPWATCH(&t, ms) {
+		for (i = 0; i < NTRACE; i++) {
+			if (cache_get(cc, TRACE[i])) hits++;
+			else cache_set(cc, TRACE[i], TRACE[i]);
+		}
+	}
+
+	printf("%-8s %8lu entries  %6.2f%% hits  %12.0f ops/s\n",
+		name, size, hits * 100.0 / NTRACE,
+		ms ? NTRACE * 1000.0 / ms : 0.0);
+	cache_free(cc);
+}
+
+int main(int argc, char **argv)
+{
+	size_t sizes[] = { 1000, 10000 };
+	size_t i;
+
+	if (argc > 1) {
+		if (file_trace(argv[1]) != 0)
+			return 1;
+	} else {
+		synthetic_trace();
+	}
+	printf("%lu requests\n", NTRACE);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		replay("lru",     VIGOR_CACHE_EVICT_LRU,    sizes[i]);
+		replay("s3-fifo", VIGOR_CACHE_EVICT_S3FIFO, sizes[i]);
+	}
+	return 0;
+}
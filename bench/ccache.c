@@ -0,0 +1,76 @@
+/*
+  Copyright 2016 James Hunt <james@jameshunt.us>
+
+  This file is part of libvigor.
+
+  libvigor is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libvigor is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libvigor.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  ccache_t scaling benchmark
+
+  Runs a mix of lookups and (on a miss, or for the given share of
+  requests) updates against a warm LRU cache, from 1 to 64 threads,
+  and reports aggregate throughput (see bench/scale.h).  Each run
+  is done twice: once against a ccache_t, and once against a plain
+  cache_t behind a single global mutex (what multi-threaded callers
+  had to do before ccache_t existed).
+ */
+
+#include "scale.h"
+
+static ccache_t *CC;
+static cache_t *C;
+static pthread_mutex_t LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+static void mutex_op(char *k, int read)
+{
+	pthread_mutex_lock(&LOCK);
+	if (!read || !cache_get(C, k))
+		cache_set(C, k, k);
+	pthread_mutex_unlock(&LOCK);
+}
+
+static void ccache_op(char *k, int read)
+{
+	if (!read || !ccache_get(CC, k))
+		ccache_set(CC, k, k);
+}
+
+int main(int argc, char **argv)
+{
+	scale_impl_t impls[] = {
+		{ "mutex",    mutex_op  },
+		{ "ccache_t", ccache_op },
+	};
+	int lru = VIGOR_CACHE_EVICT_LRU;
+	size_t i;
+
+	scale_keys();
+	CC = ccache_new(NKEYS, 3600, 0);
+	C  = cache_new(NKEYS, 3600);
+	ccache_setopt(CC, VIGOR_CACHE_EVICTION, &lru);
+	cache_setopt(C, VIGOR_CACHE_EVICTION, &lru);
+	for (i = 0; i < NKEYS; i++) {
+		ccache_set(CC, key(i), key(i));
+		cache_set(C, key(i), key(i));
+	}
+
+	scale_run(impls, sizeof(impls) / sizeof(impls[0]));
+
+	ccache_free(CC);
+	cache_free(C);
+	free(KEYS);
+	return 0;
+}
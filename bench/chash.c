@@ -0,0 +1,73 @@
+/*
+  Copyright 2016 James Hunt <james@jameshunt.us>
+
+  This file is part of libvigor.
+
+  libvigor is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libvigor is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libvigor.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  chash_t scaling benchmark
+
+  Runs a mix of lookups and updates against a pre-filled table
+  from 1 to 64 threads, for several read/write ratios, and
+  reports aggregate throughput (see bench/scale.h).  Each run is
+  done twice: once against a chash_t, and once against a plain
+  hash_t behind a single global mutex (what multi-threaded
+  callers had to do before chash_t existed).
+ */
+
+#include "scale.h"
+
+static chash_t *CH;
+static hash_t H;
+static pthread_mutex_t LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+static void mutex_op(char *k, int read)
+{
+	pthread_mutex_lock(&LOCK);
+	if (read) hash_get(&H, k);
+	else      hash_set(&H, k, k);
+	pthread_mutex_unlock(&LOCK);
+}
+
+static void chash_op(char *k, int read)
+{
+	if (read) chash_get(CH, k);
+	else      chash_set(CH, k, k);
+}
+
+int main(int argc, char **argv)
+{
+	scale_impl_t impls[] = {
+		{ "mutex",   mutex_op },
+		{ "chash_t", chash_op },
+	};
+	size_t i;
+
+	scale_keys();
+	CH = chash_new(0);
+	memset(&H, 0, sizeof(H));
+	for (i = 0; i < NKEYS; i++) {
+		chash_set(CH, key(i), key(i));
+		hash_set(&H, key(i), key(i));
+	}
+
+	scale_run(impls, sizeof(impls) / sizeof(impls[0]));
+
+	chash_free(CH, 0);
+	hash_done(&H, 0);
+	free(KEYS);
+	return 0;
+}
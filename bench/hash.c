@@ -0,0 +1,232 @@
+/*
+  Copyright 2016 James Hunt <james@jameshunt.us>
+
+  This file is part of libvigor.
+
+  libvigor is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libvigor is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libvigor.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  hash_t throughput benchmark
+
+  Measures set, get (hit) and get (miss) throughput of hash_t
+  (with and without VIGOR_HASH_ARENA), and of the original
+  64-bucket chained implementation (kept here, verbatim, as a
+  baseline), for each key count given on the command line
+  (default: 1k, 100k and 10M keys).
+
+  The legacy implementation degrades to a linear scan of
+  n/64 keys per operation, so it is skipped above LEGACY_MAX
+  keys; it would take hours to finish.
+ */
+
+#include <vigor.h>
+#include <string.h>
+
+#define LEGACY_MAX  100000
+#define MIN_OPS    1000000
+#define KEYLEN          32
+
+/************************************************************/
+
+struct legacy_bkt {
+	size_t   len;
+	char   **keys;
+	char   **values;
+};
+typedef struct {
+	struct legacy_bkt entries[64];
+	size_t len;
+} legacy_t;
+
+static uint8_t legacy_hash64(const char *s)
+{
+	unsigned int h = 81;
+	unsigned char c;
+
+	while ((c = *s++))
+		h = ((h << 5) + h) + c;
+
+	return h & ~0xc0;
+}
+
+static ssize_t legacy_index(const struct legacy_bkt *b, const char *k)
+{
+	ssize_t i;
+	for (i = 0; i < b->len; i++)
+		if (strcmp(b->keys[i], k) == 0)
+			return i;
+	return (ssize_t)-1;
+}
+
+static void* legacy_get(const legacy_t *h, const char *k)
+{
+	const struct legacy_bkt *b = &h->entries[legacy_hash64(k)];
+	ssize_t i = legacy_index(b, k);
+	return (i < 0 ? NULL : b->values[i]);
+}
+
+static void* legacy_set(legacy_t *h, const char *k, void *v)
+{
+	struct legacy_bkt *b = &h->entries[legacy_hash64(k)];
+	ssize_t i = legacy_index(b, k);
+
+	if (i < 0) {
+		b->keys   = realloc(b->keys,   (b->len + 1) * sizeof(char*));
+		b->values = realloc(b->values, (b->len + 1) * sizeof(void*));
+		b->keys[b->len]   = strdup(k);
+		b->values[b->len] = v;
+		b->len++;
+		h->len++;
+		return v;
+	}
+
+	void *existing = b->values[i];
+	b->values[i] = v;
+	return existing;
+}
+
+static void legacy_done(legacy_t *h)
+{
+	size_t i, j;
+	for (i = 0; i < 64; i++) {
+		for (j = 0; j < h->entries[i].len; j++)
+			free(h->entries[i].keys[j]);
+		free(h->entries[i].keys);
+		free(h->entries[i].values);
+	}
+	memset(h, 0, sizeof(legacy_t));
+}
+
+/************************************************************/
+
+static char *KEYS;
+
+#define key(i)  (KEYS + (i) * KEYLEN)
+#define miss(i) (KEYS + (i) * KEYLEN + 1) /* skip the leading 'k' */
+
+static void report(const char *impl, size_t n, const char *op, size_t ops, uint64_t ms)
+{
+	printf("%10lu  %-8s %-6s %12.0f ops/s\n", n, impl, op,
+		ms ? ops * 1000.0 / ms : 0.0);
+}
+
+static void bench_hash(size_t n, int arena)
+{
+	const char *impl = arena ? "arena" : "hash_t";
+	stopwatch_t t;
+	uint64_t ms = 0;
+	size_t i, r, rounds = n < MIN_OPS ? MIN_OPS / n : 1;
+	hash_t h;
+	memset(&h, 0, sizeof(h));
+
+	STOPWATCH(&t, ms) {
+		for (r = 0; r < rounds; r++) {
+			hash_done(&h, 0);
+			hash_setopt(&h, VIGOR_HASH_ARENA, &arena);
+			for (i = 0; i < n; i++)
+				hash_set(&h, key(i), key(i));
+		}
+	}
+	report(impl, n, "set", n * rounds, ms);
+
+	STOPWATCH(&t, ms) {
+		for (r = 0; r < rounds; r++)
+			for (i = 0; i < n; i++)
+				if (hash_get(&h, key(i)) != key(i))
+					abort();
+	}
+	report(impl, n, "get", n * rounds, ms);
+
+	STOPWATCH(&t, ms) {
+		for (r = 0; r < rounds; r++)
+			for (i = 0; i < n; i++)
+				if (hash_get(&h, miss(i)) != NULL)
+					abort();
+	}
+	report(impl, n, "miss", n * rounds, ms);
+
+	hash_done(&h, 0);
+}
+
+static void bench_legacy(size_t n)
+{
+	stopwatch_t t;
+	uint64_t ms = 0;
+	size_t i, r, rounds = n < MIN_OPS / 100 ? MIN_OPS / 100 / n : 1;
+	legacy_t h;
+	memset(&h, 0, sizeof(h));
+
+	if (n > LEGACY_MAX) {
+		printf("%10lu  %-8s (skipped; more than %d keys)\n", n, "legacy", LEGACY_MAX);
+		return;
+	}
+
+	STOPWATCH(&t, ms) {
+		for (r = 0; r < rounds; r++) {
+			legacy_done(&h);
+			for (i = 0; i < n; i++)
+				legacy_set(&h, key(i), key(i));
+		}
+	}
+	report("legacy", n, "set", n * rounds, ms);
+
+	STOPWATCH(&t, ms) {
+		for (r = 0; r < rounds; r++)
+			for (i = 0; i < n; i++)
+				if (legacy_get(&h, key(i)) != key(i))
+					abort();
+	}
+	report("legacy", n, "get", n * rounds, ms);
+
+	STOPWATCH(&t, ms) {
+		for (r = 0; r < rounds; r++)
+			for (i = 0; i < n; i++)
+				if (legacy_get(&h, miss(i)) != NULL)
+					abort();
+	}
+	report("legacy", n, "miss", n * rounds, ms);
+
+	legacy_done(&h);
+}
+
+int main(int argc, char **argv)
+{
+	size_t sizes[] = { 1000, 100000, 10000000 };
+	size_t i, j, n, max = 0;
+
+	if (argc > 1) {
+		for (i = 1; i < argc; i++) {
+			n = strtoul(argv[i], NULL, 10);
+			if (n > max) max = n;
+		}
+	} else {
+		max = sizes[2];
+	}
+
+	KEYS = vcalloc(max, KEYLEN);
+	for (i = 0; i < max; i++)
+		snprintf(key(i), KEYLEN, "k:%08x:%lu", (unsigned int)(i * 2654435761u), i);
+
+	for (j = 0; j < (argc > 1 ? argc - 1 : 3); j++) {
+		n = argc > 1 ? strtoul(argv[j + 1], NULL, 10) : sizes[j];
+		if (!n) continue;
+		bench_hash(n, 0);
+		bench_hash(n, 1);
+		bench_legacy(n);
+	}
+
+	free(KEYS);
+	return 0;
+}
@@ -0,0 +1,126 @@
+/*
+  Copyright 2016 James Hunt <james@jameshunt.us>
+
+  This file is part of libvigor.
+
+  libvigor is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libvigor is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libvigor.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  Thread-scaling harness, shared by the concurrent data structure
+  benchmarks (bench/chash.c, bench/ccache.c).
+
+  Each benchmark fills in NKEYS keys, and supplies a table of
+  implementations, each with a function that performs a single
+  request against it: a lookup if `read` is set, an update if not.
+  scale_run() then runs a mix of requests (with 100%, 90% and 50%
+  lookups) against every implementation, from 1 to 64 threads, and
+  reports aggregate throughput.
+ */
+
+#ifndef VIGOR_BENCH_SCALE_H
+#define VIGOR_BENCH_SCALE_H
+
+#include <vigor.h>
+#include <string.h>
+
+#define NKEYS   100000
+#define NOPS    2000000 /* per run, split across all threads */
+#define KEYLEN  32
+
+static char *KEYS;
+#define key(i) (KEYS + (i) * KEYLEN)
+
+typedef struct {
+	const char *name;
+	void      (*op)(char *k, int read);
+} scale_impl_t;
+
+typedef struct {
+	pthread_t           tid;
+	const scale_impl_t *impl;
+	int                 reads;  /* out of 100 */
+	size_t              ops;
+	uint64_t            rng;
+} worker_t;
+
+static inline uint64_t xorshift(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+/* Allocate and format the NKEYS benchmark keys. */
+static void scale_keys(void)
+{
+	size_t i;
+
+	KEYS = vcalloc(NKEYS, KEYLEN);
+	for (i = 0; i < NKEYS; i++)
+		snprintf(key(i), KEYLEN, "key:%lu", i);
+}
+
+static void* worker(void *arg)
+{
+	worker_t *w = arg;
+	size_t i;
+
+	for (i = 0; i < w->ops; i++) {
+		uint64_t r = xorshift(&w->rng);
+		w->impl->op(key(r % NKEYS), (r >> 32) % 100 < w->reads);
+	}
+	return NULL;
+}
+
+static void measure(const scale_impl_t *impl, int nthreads, int reads)
+{
+	worker_t w[64];
+	stopwatch_t t;
+	uint64_t ms = 0;
+	int i;
+
+	STOPWATCH(&t, ms) {
+		for (i = 0; i < nthreads; i++) {
+			w[i].impl  = impl;
+			w[i].reads = reads;
+			w[i].ops   = NOPS / nthreads;
+			w[i].rng   = 0x9e3779b97f4a7c15ull * (i + 1);
+			pthread_create(&w[i].tid, NULL, worker, &w[i]);
+		}
+		for (i = 0; i < nthreads; i++)
+			pthread_join(w[i].tid, NULL);
+	}
+
+	printf("%-8s %3d%% reads %3d threads %12.0f ops/s\n",
+		impl->name, reads, nthreads,
+		ms ? (NOPS / nthreads) * nthreads * 1000.0 / ms : 0.0);
+}
+
+/* Measure each of the $n implementations in $impls, for every
+   read/write ratio and thread count. */
+static void scale_run(const scale_impl_t *impls, size_t n)
+{
+	int threads[] = { 1, 2, 4, 8, 16, 32, 64 };
+	int ratios[]  = { 100, 90, 50 };
+	size_t i, j, k;
+
+	for (i = 0; i < sizeof(ratios) / sizeof(ratios[0]); i++)
+		for (j = 0; j < sizeof(threads) / sizeof(threads[0]); j++)
+			for (k = 0; k < n; k++)
+				measure(&impls[k], threads[j], ratios[i]);
+}
+
+#endif
@@ -37,6 +37,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <syslog.h> /* so callers get LOG_* constants */
@@ -154,29 +155,171 @@ list_t* list_pop  (list_t *l);
     ##    ##  ##     ##  ######   ##    ##  ########  ######
  */
 typedef struct hash hash_t;
-struct hash_bkt {
-	size_t   len;
-	char   **keys;
-	char   **values;
+typedef uint64_t (*hash_fn)(const void *key, size_t len, uint64_t seed);
+struct hash_slot {
+	uint64_t  hash;
+	union {
+		char     *key;
+		uint64_t  ikey;   /* ihash_t keys are stored inline */
+	};
+	size_t    klen;
+	void     *value;
+};
+struct hash_table {
+	uint8_t          *ctrl;   /* per-slot control bytes; see src/hash.c */
+	struct hash_slot *slots;
+	size_t            cap;    /* number of slots; zero or a power of two */
+	size_t            used;   /* live keys + deleted-key tombstones */
 };
 struct hash {
-	struct hash_bkt entries[64];
-	ssize_t         bucket;
-	ssize_t         offset;
-	size_t          len;
+	struct hash_table tab;
+	struct hash_table old;      /* outgrown table, still being migrated */
+	size_t            migrated; /* old slots migrated so far */
+	size_t            step;     /* old slots to migrate per update (0, or >= 4) */
+
+	ssize_t           bucket;   /* iteration cursor, see hash_next */
+	size_t            len;
+
+	uint64_t          seed;
+	hash_fn           hashfn;
+	void             *arena;    /* key storage, see hash_setopt */
+	void             *intern;   /* key intern pool, ditto */
+	uint8_t           keys;     /* string, binary or integer keys */
 };
+
+#define VIGOR_HASH_FUNCTION    1
+#define VIGOR_HASH_SEED        2
+#define VIGOR_HASH_INCREMENTAL 3
+#define VIGOR_HASH_ARENA       4
+#define VIGOR_HASH_INTERN      5
+
+uint64_t hash64(const void *key, size_t len, uint64_t seed);
+int hash_setopt(hash_t *h, int op, const void *value);
 void hash_done(hash_t *h, uint8_t all);
 void* hash_get(const hash_t *h, const char *k);
 void* hash_set(hash_t *h, const char *k, void *v);
 void* hash_unset(hash_t *h, const char *k);
 void* hash_next(hash_t *h, char **k, void **v);
-void hash_merge(hash_t *a, hash_t *b);
+void hash_merge(hash_t *a, const hash_t *b);
+
+typedef struct {
+	const hash_t *hash;
+	size_t        pos;
+} hash_iter_t;
+void* hash_iter_next(hash_iter_t *it, char **k, void **v);
 
 #define hash_len(h) \
-	(h->len)
+	((h)->len)
 #define for_each_key_value(h,k,v) \
-	for ((h)->offset = (h)->bucket = 0; \
+	for ((h)->bucket = 0; \
 	     hash_next((h), &(k), (void**)&(v)); )
+#define for_each_key_value_iter(it,h,k,v) \
+	for ((it).hash = (h), (it).pos = 0; \
+	     hash_iter_next(&(it), &(k), (void**)&(v)); )
+
+typedef struct { hash_t h; } ihash_t;
+
+int ihash_setopt(ihash_t *h, int op, const void *value);
+void ihash_done(ihash_t *h, uint8_t all);
+void* ihash_get(const ihash_t *h, uint64_t k);
+void* ihash_set(ihash_t *h, uint64_t k, void *v);
+void* ihash_unset(ihash_t *h, uint64_t k);
+int ihash_iter_next(hash_iter_t *it, uint64_t *k, void **v);
+
+#define ihash_len(x) \
+	((x)->h.len)
+#define for_each_ihash_key_value(it,x,k,v) \
+	for ((it).hash = &(x)->h, (it).pos = 0; \
+	     ihash_iter_next(&(it), &(k), (void**)&(v)); )
+
+typedef struct { hash_t h; } bhash_t;
+
+int bhash_setopt(bhash_t *h, int op, const void *value);
+void bhash_done(bhash_t *h, uint8_t all);
+void* bhash_get(const bhash_t *h, const void *k, size_t len);
+void* bhash_set(bhash_t *h, const void *k, size_t len, void *v);
+void* bhash_unset(bhash_t *h, const void *k, size_t len);
+int bhash_iter_next(hash_iter_t *it, const void **k, size_t *len, void **v);
+
+#define bhash_len(x) \
+	((x)->h.len)
+#define for_each_bhash_key_value(it,x,k,len,v) \
+	for ((it).hash = &(x)->h, (it).pos = 0; \
+	     bhash_iter_next(&(it), &(k), &(len), (void**)&(v)); )
+
+typedef struct {
+	pthread_rwlock_t lock;
+	hash_t           hash;
+} __attribute__((aligned(64))) chash_shard_t;
+
+typedef struct {
+	size_t         n;      /* number of shards; a power of two */
+	uint64_t       seed;
+	chash_shard_t *shards;
+} chash_t;
+
+chash_t* chash_new(size_t shards);
+void chash_free(chash_t *ch, uint8_t all);
+void* chash_get(chash_t *ch, const char *k);
+void* chash_set(chash_t *ch, const char *k, void *v);
+void* chash_unset(chash_t *ch, const char *k);
+size_t chash_len(chash_t *ch);
+
+typedef struct {
+	pthread_rwlock_t lock;
+	hash_t           strings;
+} intern_t;
+
+intern_t* intern_new(void);
+void intern_free(intern_t *pool);
+intern_t* intern_global(void);
+const char* intern(intern_t *pool, const char *s);
+const char* intern_n(intern_t *pool, const void *s, size_t len);
+const char* intern_find(intern_t *pool, const char *s);
+const char* intern_find_n(intern_t *pool, const void *s, size_t len);
+size_t intern_len(intern_t *pool);
+
+/*
+  Perfect hashes map a fixed set of strings, known at build
+  time, to distinct indices in [0, n).  The tables are written
+  by the phash-gen tool (see tools/phash-gen.c), and looked up
+  entirely in-line: one hash, and one strcmp().
+ */
+typedef struct {
+	uint64_t        seed;
+	uint32_t        n;      /* number of keys */
+	uint32_t        nb;     /* number of buckets */
+	const uint32_t *disp;   /* per-bucket displacements */
+	const char    **keys;   /* keys, in slot order */
+} phash_t;
+
+static inline uint64_t phash64(const char *k, size_t len, uint64_t seed)
+{
+	uint64_t h = 0xcbf29ce484222325ull ^ seed;
+	while (len--) {
+		h ^= (unsigned char)*k++;
+		h *= 0x100000001b3ull;
+	}
+	h ^= h >> 33; h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+static inline uint32_t phash_slot(const phash_t *ph, uint64_t h)
+{
+	uint32_t d  = ph->disp[(h >> 32) % ph->nb];
+	uint32_t f1 = (uint32_t)h % ph->n;
+	uint32_t f2 = (uint32_t)((h * 0x9e3779b97f4a7c15ull) >> 32) % ph->n;
+	return (uint32_t)((f1 + (uint64_t)(d >> 16) * f2 + (d & 0xffff)) % ph->n);
+}
+
+static inline int phash_find(const phash_t *ph, const char *k)
+{
+	if (!k || !ph->n) return -1;
+	uint32_t i = phash_slot(ph, phash64(k, strlen(k), ph->seed));
+	return strcmp(ph->keys[i], k) == 0 ? (int)i : -1;
+}
 
 /*
      ######   #######  ##    ## ######## ####  ######
@@ -194,6 +337,7 @@ struct keyval {
 	char *key;
 	char *val;
 	list_t l;
+	uint8_t interned; /* key is interned; see config_set_interned */
 };
 
 #define CONFIG(n) config_t n = { &(n), &(n) }
@@ -202,6 +346,8 @@ int config_unset(config_t *cfg, const char *key);
 char* config_get(config_t *cfg, const char *key);
 int config_isset(config_t *cfg, const char *key);
 int config_read (config_t *cfg, FILE *io);
+int config_set_interned(config_t *cfg, const char *key, const char *val, intern_t *pool);
+int config_read_interned(config_t *cfg, FILE *io, intern_t *pool);
 int config_write(config_t *cfg, FILE *io);
 void config_done(config_t *cfg);
 
@@ -220,26 +366,83 @@ void config_done(config_t *cfg);
 typedef struct {
 	char    *ident;
 	int32_t  last_seen;
+	int32_t  expires;  /* per-entry deadline (see cache_set_ttl), or 0 */
+	uint8_t  freq;     /* S3-FIFO access count (0-3) */
+	uint8_t  queue;    /* S3-FIFO queue (small or main) */
+	uint8_t  used;     /* access bit, set by ccache_get */
+	size_t   cost;     /* caller-supplied size (see cache_set_cost) */
 	void    *data;
+	list_t   l;        /* free list, or recency / FIFO queue */
+	list_t   t;        /* expiry timer wheel bucket */
 } cache_entry_t;
 
 typedef struct {
-	size_t  __reserved1__;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t inserts;     /* new keys */
+	uint64_t evictions;   /* by the eviction policy */
+	uint64_t expirations;
+	uint64_t rejected;    /* sets that failed, for lack of room */
+
+	size_t   len;         /* current occupancy (see cache_stats) */
+	size_t   max_len;
+	size_t   cost;
+	size_t   max_cost;
+} cache_stats_t;
+
+typedef struct {
+	size_t  len;       /* live entries */
 	size_t  max_len;
+	size_t  cost;      /* total cost of live entries */
+	size_t  max_cost;  /* cost budget (VIGOR_CACHE_BUDGET), or 0 */
 	int32_t expire;
+	int32_t absent_expire; /* TTL of cache_set_absent entries */
 
 	void (*destroy_f)(void*);
+	int     evict;     /* VIGOR_CACHE_EVICT_* policy */
+
+	list_t      free;  /* unused entries */
+	list_t      live;  /* live entries, least recently used first */
+
+	list_t      small; /* S3-FIFO probationary queue, oldest first */
+	size_t      nsmall;
+	size_t      csmall; /* total cost of the small queue */
+	struct {
+		uint64_t *ring; /* hashes of keys recently evicted from small */
+		size_t    next;
+		size_t    len;
+		ihash_t   index;
+	} ghost;
+
+	int32_t     wheel_at;   /* oldest timer wheel bucket not yet purged */
+	list_t      wheel[256]; /* live entries, by expiry time (mod 256s) */
+
+	pthread_mutex_t lock;    /* held by cache_get_or_load */
+	hash_t          loading; /* loads in flight, by key */
 
 	hash_t      index;
-	cache_entry_t  entries[];
+	cache_stats_t stats;
+
+	size_t          nchunks;
+	cache_entry_t **chunks;  /* entry storage; see cache_resize */
 } cache_t;
 
 #define for_each_cache_key(cc,k) \
-	for ((cc)->index.offset = (cc)->index.bucket = 0; \
+	for ((cc)->index.bucket = 0; \
 	     hash_next(&(cc)->index, &(k), NULL); )
 
 #define VIGOR_CACHE_DESTRUCTOR 1
 #define VIGOR_CACHE_EXPIRY     2
+#define VIGOR_CACHE_EVICTION   3
+#define VIGOR_CACHE_BUDGET     4
+#define VIGOR_CACHE_ABSENT_EXPIRY 5
+
+/* returned by cache_get (and friends) for keys known not to exist */
+#define VIGOR_CACHE_ABSENT ((void *)-1)
+
+#define VIGOR_CACHE_EVICT_NONE   0
+#define VIGOR_CACHE_EVICT_LRU    1
+#define VIGOR_CACHE_EVICT_S3FIFO 2
 
 cache_t* cache_new(size_t max, int32_t expire);
 void cache_free(cache_t *cc);
@@ -248,6 +451,37 @@ int cache_resize(cache_t **cc, size_t max);
 int   cache_setopt(cache_t *cc, int op, const void *value);
 void* cache_get(cache_t *cc, const char *id);
 void* cache_set(cache_t *cc, const char *id, void *data);
+void* cache_set_ttl(cache_t *cc, const char *id, void *data, int32_t ttl);
+void* cache_set_cost(cache_t *cc, const char *id, void *data, size_t cost);
+int   cache_set_absent(cache_t *cc, const char *id);
+void* cache_get_or_load(cache_t *cc, const char *id, void* (*load)(const char*, void*), void *ctx);
+ssize_t cache_save(cache_t *cc, int fd, ssize_t (*pack)(const void*, void*, size_t));
+ssize_t cache_load(cache_t *cc, int fd, void* (*unpack)(const void*, size_t));
+void cache_stats(cache_t *cc, cache_stats_t *st);
+
+typedef struct {
+	pthread_rwlock_t lock;
+	cache_t         *cache;
+} __attribute__((aligned(64))) ccache_shard_t;
+
+typedef struct {
+	size_t          n;      /* number of shards; a power of two */
+	uint64_t        seed;
+	ccache_shard_t *shards;
+} ccache_t;
+
+ccache_t* ccache_new(size_t max, int32_t expire, size_t shards);
+void ccache_free(ccache_t *cc);
+void ccache_purge(ccache_t *cc, int force);
+int   ccache_setopt(ccache_t *cc, int op, const void *value);
+void* ccache_get(ccache_t *cc, const char *id);
+void* ccache_set(ccache_t *cc, const char *id, void *data);
+void* ccache_set_ttl(ccache_t *cc, const char *id, void *data, int32_t ttl);
+void* ccache_set_cost(ccache_t *cc, const char *id, void *data, size_t cost);
+int   ccache_set_absent(ccache_t *cc, const char *id);
+void* ccache_unset(ccache_t *cc, const char *id);
+size_t ccache_len(ccache_t *cc);
+void ccache_stats(ccache_t *cc, cache_stats_t *st);
 void* cache_unset(cache_t *cc, const char *id);
 void cache_touch(cache_t *cc, const char *id, int32_t last);
 int cache_isfull(cache_t *cc);
@@ -270,24 +504,49 @@ typedef struct {
 	size_t   num;      /* number of actual strings */
 	size_t   len;      /* number of memory slots for strings */
 	char   **strings;  /* array of NULL-terminated strings */
+	void    *arena;    /* string storage, see strings_new_arena */
 } strings_t;
 typedef int (*strings_cmp_fn)(const void*, const void*);
 
 #define SPLIT_NORMAL  0
 #define SPLIT_GREEDY  1
+#define SPLIT_ARENA   2
 
 #define for_each_string(l,i) for ((i)=0; (i)<(l)->num; (i)++)
 
+typedef struct {
+	const char *ptr;   /* first octet of the string (not NUL-terminated) */
+	size_t      len;   /* length of the string, in octets */
+} strview_t;
+
+typedef struct {
+	const char *next;      /* start of the next token */
+	const char *end;       /* end of the string being split */
+	const char *delim;     /* token separator */
+	size_t      delim_len; /* length of $delim */
+	int         opt;       /* SPLIT_NORMAL or SPLIT_GREEDY */
+} strsplit_t;
+
+strview_t strview(const char *s);
+int strview_eq(strview_t v, const char *s);
+char* strview_dup(strview_t v);
+void strsplit_init(strsplit_t *it, const char *str, size_t len, const char *delim, int opt);
+int strsplit_next(strsplit_t *it, strview_t *tok);
+
 int STRINGS_ASC(const void *a, const void *b);
 int STRINGS_DESC(const void *a, const void *b);
 
 strings_t* strings_new(char** src);
+strings_t* strings_new_arena(char** src);
 strings_t* strings_dup(strings_t *orig);
 void strings_free(strings_t *list);
 void strings_sort(strings_t *list, strings_cmp_fn cmp);
 void strings_uniq(strings_t *list);
 int strings_search(const strings_t *list, const char *needle);
+int strings_search_view(const strings_t *list, strview_t needle);
+int strings_reserve(strings_t *list, size_t n);
 int strings_add(strings_t *list, const char *value);
+int strings_add_view(strings_t *list, strview_t value);
 int strings_add_all(strings_t *dst, const strings_t *src);
 int strings_remove(strings_t *list, const char *value);
 int strings_remove_all(strings_t *dst, strings_t *src);
@@ -567,6 +826,7 @@ typedef struct {
 	char   *type;
 	int     len;
 	list_t  frames;
+	uint8_t itype;   /* type is interned; see pdu_type_interned */
 } pdu_t;
 
 void* vzmq_ident(void *zocket, void *id);
@@ -583,7 +843,9 @@ void pdu_free(pdu_t *p);
 
 #define pdu_size(p) ((p)->len)
 char* pdu_peer(pdu_t *p);
+const void* pdu_address(pdu_t *p, size_t *len);
 char* pdu_type(pdu_t *p);
+char* pdu_type_interned(pdu_t *p, intern_t *pool);
 int pdu_attn(pdu_t *p, const char *peer);
 
 int pdu_copy(pdu_t *to, pdu_t *from, int start, int n);
@@ -32,6 +32,72 @@
 
 */
 
+/*
+  Expiry is tracked with a hashed timer wheel: each live entry is
+  kept in the bucket for the second at which it expires (that is,
+  last_seen + expire + 1), modulo the number of buckets.  Purging
+  only has to look at the buckets for the seconds that have gone
+  by since the last purge (at most, all of them), instead of at
+  every entry in the cache.
+
+  Entries set with @cache_set_ttl expire at a fixed deadline,
+  instead; otherwise, accessing an entry pushes its expiry back,
+  but doesn't move it;
+  when the purge gets to its (old) bucket, it notices that the
+  entry hasn't expired yet, and moves it to the right bucket.
+  Likewise, entries that expire more than a revolution of the
+  wheel from now are just skipped until their time comes.
+ */
+#define CACHE_WHEEL_SLOTS (sizeof(((cache_t *)0)->wheel) / sizeof(list_t))
+#define CACHE_RECLAIM_MAX 8 /* expired entries reclaimed per insert */
+
+static inline int64_t s_cache_expiry(cache_t *cc, cache_entry_t *ent)
+{
+	if (ent->expires)
+		return ent->expires;
+	/* may be racing with s_cache_peek() (under a ccache_t read lock) */
+	return (int64_t)__atomic_load_n(&ent->last_seen, __ATOMIC_RELAXED) + cc->expire + 1;
+}
+
+/* File $ent in the timer wheel bucket for its expiry time, or for
+   the next purge, if it should already have expired. */
+static void s_cache_schedule(cache_t *cc, cache_entry_t *ent)
+{
+	int64_t at = s_cache_expiry(cc, ent);
+	if (at < cc->wheel_at)
+		at = cc->wheel_at;
+
+	list_delete(&ent->t);
+	list_push(&cc->wheel[at % CACHE_WHEEL_SLOTS], &ent->t);
+}
+
+/* Add a chunk of $n new (free) entries to $cc.  Entries never
+   move once allocated, so the index can point right at them. */
+static int s_cache_grow(cache_t *cc, size_t n)
+{
+	if (!n) return 0;
+
+	cache_entry_t **chunks = realloc(cc->chunks, (cc->nchunks + 1) * sizeof(cache_entry_t *));
+	if (!chunks) {
+		errno = ENOMEM;
+		return -1;
+	}
+	cc->chunks = chunks;
+
+	cache_entry_t *chunk = calloc(n, sizeof(cache_entry_t));
+	if (!chunk) {
+		errno = ENOMEM;
+		return -1;
+	}
+	cc->chunks[cc->nchunks++] = chunk;
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		list_push(&cc->free, &chunk[i].l);
+	cc->max_len += n;
+	return 0;
+}
+
 /**
   Create a new, general purpose cache.
 
@@ -48,17 +114,31 @@
   overly large.
 
   On success, returns a pointer to a new `cache_t` with the given $len
-  and $expire parameters.
+  and $expire parameters.  On failure, returns NULL.
 
   To release the memory used by a cache, see @cache_free.
  */
 cache_t* cache_new(size_t len, int32_t expire)
 {
-	cache_t *cc  = vmalloc(sizeof(cache_t)
-	                     + sizeof(cache_entry_t) * len);
-	cc->max_len  = len;
+	cache_t *cc  = vmalloc(sizeof(cache_t));
 	cc->expire = expire;
+	cc->absent_expire = expire;
 	memset(&cc->index, 0, sizeof(hash_t));
+	memset(&cc->loading, 0, sizeof(hash_t));
+
+	size_t i;
+	list_init(&cc->live);
+	list_init(&cc->small);
+	list_init(&cc->free);
+	if (s_cache_grow(cc, len) != 0) {
+		free(cc);
+		return NULL;
+	}
+	pthread_mutex_init(&cc->lock, NULL);
+
+	cc->wheel_at = time_s();
+	for (i = 0; i < CACHE_WHEEL_SLOTS; i++)
+		list_init(&cc->wheel[i]);
 	return cc;
 }
 
@@ -69,32 +149,56 @@ cache_t* cache_new(size_t len, int32_t expire)
   increasing the amount of memory in which the cache resides.
   It is an error to try to reduce the size of a cache.
 
+  The cache grows in place: a new chunk of entries is added to
+  it, and existing entries (and their keys, data and place in the
+  eviction and expiry queues) are left exactly where they are, so
+  growing a busy cache costs no more than allocating the room.
+  *$cc is never changed.
+
   On success, resizes $cc and returns 0.
 
   On failure, returns -1 and sets errno appropriately:
 
     - **`EINVAL`** - $len is less than the current cache size.
+    - **`ENOMEM`** - Memory for the new entries could not be allocated.
 
-  The cache is guaranteed to remain unmodified on failure.
+  The cache is guaranteed to remain usable (and keep its entries)
+  on failure.
  */
 int cache_resize(cache_t **cc, size_t len)
 {
+	cache_t *c = *cc;
+
 	errno = EINVAL;
-	if (len < (*cc)->max_len)
+	if (len < c->max_len)
 		return -1;
 
-	if (len > (*cc)->max_len) {
-		cache_t *new = cache_new(len, (*cc)->expire);
+	if (len == c->max_len)
+		return 0;
 
-		char *k; void *v;
-		for_each_key_value(&(*cc)->index, k, v)
-			hash_set(&new->index, k, v);
+	/* the S3-FIFO ghost queue is as long as the cache */
+	uint64_t *ring = NULL;
+	if (c->ghost.ring && !(ring = calloc(len, sizeof(uint64_t)))) {
+		errno = ENOMEM;
+		return -1;
+	}
 
-		new->destroy_f = (*cc)->destroy_f;
-		cache_free((*cc));
-		*cc = new;
+	size_t i, was = c->max_len;
+	if (s_cache_grow(c, len - was) != 0) {
+		free(ring);
+		return -1;
 	}
 
+	if (ring) {
+		/* unroll it into the new, longer ring, oldest first */
+		size_t start = was ? (c->ghost.next + was - c->ghost.len) % was : 0;
+		for (i = 0; i < c->ghost.len; i++)
+			ring[i] = c->ghost.ring[(start + i) % was];
+
+		free(c->ghost.ring);
+		c->ghost.ring = ring;
+		c->ghost.next = c->ghost.len;
+	}
 	return 0;
 }
 
@@ -109,9 +213,228 @@ void cache_free(cache_t *cc)
 
 	cache_purge(cc, 1);
 	hash_done(&cc->index, 0);
+	hash_done(&cc->loading, 0);
+	pthread_mutex_destroy(&cc->lock);
+	ihash_done(&cc->ghost.index, 0);
+	free(cc->ghost.ring);
+	while (cc->nchunks > 0)
+		free(cc->chunks[--cc->nchunks]);
+	free(cc->chunks);
 	free(cc);
 }
 
+/*
+  Eviction policies decide which entry to evict when a new key is
+  set in a full cache.
+
+  LRU keeps live entries in recency order (cc->live); every hit
+  moves the entry to the tail, and the head gets evicted.
+
+  S3-FIFO (Yang et al, SOSP '23) keeps two FIFO queues: new keys
+  go on a small, probationary queue (about 10% of the cache), and
+  the rest live on the main queue (cc->live).  Hits only bump a
+  2-bit access counter; nothing moves.  Keys that reach the head
+  of the small queue without being accessed again are evicted,
+  and remembered (by hash) in a ghost queue; accessed ones move
+  to the main queue.  Keys found in the ghost queue when they are
+  set again go straight to the main queue.  Entries reaching the
+  head of the main queue are evicted if their counter is zero, or
+  re-queued (with the counter decremented) if not.
+
+  Since one-hit wonders never make it past the small queue, a
+  sweep over lots of cold keys can't flush the hot set out of
+  the main queue, as it would with LRU.
+
+  With a cost budget (VIGOR_CACHE_BUDGET), "about 10%" is measured
+  in cost as well as in entries, so that a few large new entries
+  can't crowd out the main queue.
+ */
+#define CACHE_QUEUE_MAIN  0
+#define CACHE_QUEUE_SMALL 1
+#define CACHE_FREQ_MAX    3
+
+static inline uint64_t s_cache_hash(cache_t *cc, const char *id)
+{
+	return hash64(id, strlen(id), cc->index.seed);
+}
+
+static int s_cache_ghosted(cache_t *cc, uint64_t hv)
+{
+	return ihash_get(&cc->ghost.index, hv) != NULL;
+}
+
+/* Remember $hv in the (bounded) ghost queue of $cc. */
+static void s_cache_ghost(cache_t *cc, uint64_t hv)
+{
+	uintptr_t n;
+
+	if (!cc->ghost.ring)
+		return;
+
+	if (cc->ghost.len == cc->max_len) {
+		uint64_t old = cc->ghost.ring[cc->ghost.next];
+		n = (uintptr_t)ihash_get(&cc->ghost.index, old);
+		if (n > 1) ihash_set(&cc->ghost.index, old, (void *)(n - 1));
+		else       ihash_unset(&cc->ghost.index, old);
+	} else {
+		cc->ghost.len++;
+	}
+
+	cc->ghost.ring[cc->ghost.next] = hv;
+	cc->ghost.next = (cc->ghost.next + 1) % cc->max_len;
+
+	n = (uintptr_t)ihash_get(&cc->ghost.index, hv);
+	ihash_set(&cc->ghost.index, hv, (void *)(n + 1));
+}
+
+/* Count a hit recorded by s_cache_peek() (see ccache_get). */
+static inline void s_cache_fold(cache_entry_t *ent)
+{
+	if (ent->used) {
+		ent->used = 0;
+		if (ent->freq < CACHE_FREQ_MAX)
+			ent->freq++;
+	}
+}
+
+/* Pick the next S3-FIFO victim; $cc must not be empty. */
+static cache_entry_t* s_cache_s3fifo_victim(cache_t *cc)
+{
+	cache_entry_t *ent;
+
+	for (;;) {
+		if (cc->nsmall && (cc->nsmall >= cc->max_len / 10
+		                || (cc->max_cost && cc->csmall >= cc->max_cost / 10)
+		                || list_isempty(&cc->live))) {
+			ent = list_head(&cc->small, cache_entry_t, l);
+			s_cache_fold(ent);
+			if (!ent->freq) {
+				s_cache_ghost(cc, s_cache_hash(cc, ent->ident));
+				return ent;
+			}
+			cc->nsmall--;
+			cc->csmall -= ent->cost;
+			ent->queue = CACHE_QUEUE_MAIN;
+			ent->freq  = 0;
+
+		} else {
+			ent = list_head(&cc->live, cache_entry_t, l);
+			s_cache_fold(ent);
+			if (!ent->freq)
+				return ent;
+			ent->freq--;
+		}
+
+		list_delete(&ent->l);
+		list_push(&cc->live, &ent->l);
+	}
+}
+
+/* Remove live entry $ent from $cc, returning its data. */
+static void* s_cache_drop(cache_t *cc, cache_entry_t *ent)
+{
+	void *d = ent->data;
+
+	hash_unset(&cc->index, ent->ident);
+	free(ent->ident);
+	ent->ident = NULL;
+	ent->data = NULL;
+	ent->last_seen = -1;
+	ent->expires = 0;
+	list_delete(&ent->t);
+
+	if (ent->queue == CACHE_QUEUE_SMALL) {
+		cc->nsmall--;
+		cc->csmall -= ent->cost;
+	}
+	ent->queue = CACHE_QUEUE_MAIN;
+	ent->freq  = 0;
+	ent->used  = 0;
+	cc->cost -= ent->cost;
+	ent->cost = 0;
+
+	list_delete(&ent->l);
+	list_push(&cc->free, &ent->l);
+	cc->len--;
+	return d;
+}
+
+/* Pass $data (from a dropped entry) to the destructor, if any;
+   negative entries have nothing to destroy. */
+static inline void s_cache_destroy(cache_t *cc, void *data)
+{
+	if (cc->destroy_f && data != VIGOR_CACHE_ABSENT)
+		(*cc->destroy_f)(data);
+}
+
+/* Evict (and destroy) one entry, according to the eviction policy.
+   Returns 0 if there is no policy, or nothing to evict. */
+static int s_cache_evict(cache_t *cc)
+{
+	if (cc->evict == VIGOR_CACHE_EVICT_NONE || !cc->len)
+		return 0;
+
+	cache_entry_t *victim;
+	if (cc->evict == VIGOR_CACHE_EVICT_LRU) {
+		/* entries hit via s_cache_peek() get a second chance */
+		for (;;) {
+			victim = list_head(&cc->live, cache_entry_t, l);
+			if (!victim->used)
+				break;
+			victim->used = 0;
+			list_delete(&victim->l);
+			list_push(&cc->live, &victim->l);
+		}
+	} else {
+		victim = s_cache_s3fifo_victim(cc);
+	}
+	cc->stats.evictions++;
+	s_cache_destroy(cc, s_cache_drop(cc, victim));
+	return 1;
+}
+
+/* Drop (and destroy) expired entry $ent. */
+static void s_cache_expired(cache_t *cc, cache_entry_t *ent)
+{
+	cc->stats.expirations++;
+	s_cache_destroy(cc, s_cache_drop(cc, ent));
+}
+
+/* Turn the timer wheel up to $now, dropping at most $max expired
+   entries.  Returns how many were dropped; if that's $max, the
+   wheel stops where it is, and picks up from there next time. */
+static size_t s_cache_expire(cache_t *cc, int32_t now, size_t max)
+{
+	cache_entry_t *ent, *tmp;
+	size_t n = 0;
+	int64_t at = cc->wheel_at;
+
+	if ((int64_t)now - at >= (int64_t)CACHE_WHEEL_SLOTS)
+		at = (int64_t)now - CACHE_WHEEL_SLOTS + 1;
+
+	for (; at <= now; at++) {
+		list_t *bucket = &cc->wheel[at % CACHE_WHEEL_SLOTS];
+		for_each_object_safe(ent, tmp, bucket, t) {
+			int64_t expiry = s_cache_expiry(cc, ent);
+			if (expiry <= now) {
+				if (n == max) {
+					cc->wheel_at = at;
+					return n;
+				}
+				s_cache_expired(cc, ent);
+				n++;
+
+			} else if (&cc->wheel[expiry % CACHE_WHEEL_SLOTS] != bucket) {
+				list_delete(&ent->t);
+				list_push(&cc->wheel[expiry % CACHE_WHEEL_SLOTS], &ent->t);
+			}
+		}
+	}
+	if (now > cc->wheel_at)
+		cc->wheel_at = now;
+	return n;
+}
+
 /**
   Purge expired cache entries.
 
@@ -122,30 +445,25 @@ void cache_free(cache_t *cc)
   The $force flag can be used to side-step the expiration logic and purge
   all entries in the cache.  This is akin to calling @cache_free, except
   that you can re-use the cache afterwards.
+
+  The cost of a (non-forced) purge depends on how many entries have
+  expired, and how long it's been since the last purge, rather than
+  on the size of the cache; it is cheap enough to call every second.
  */
 void cache_purge(cache_t *cc, int force)
 {
-	int32_t now = time_s();
-	int i;
-	for (i = 0; i < cc->max_len; i++) {
-		if (!force &&
-		     (cc->entries[i].last_seen == -1
-		   || cc->entries[i].last_seen >= now - cc->expire))
-			continue;
-
-		if (cc->entries[i].ident) {
-			hash_set(&cc->index, cc->entries[i].ident, NULL);
+	if (force) {
+		cache_entry_t *ent, *tmp;
+		size_t i;
 
-			free(cc->entries[i].ident);
-			cc->entries[i].ident = NULL;
-
-			if (cc->destroy_f)
-				(*cc->destroy_f)(cc->entries[i].data);
-			cc->entries[i].data = NULL;
-
-			cc->entries[i].last_seen = -1;
+		for (i = 0; i < CACHE_WHEEL_SLOTS; i++) {
+			for_each_object_safe(ent, tmp, &cc->wheel[i], t)
+				s_cache_destroy(cc, s_cache_drop(cc, ent));
 		}
+		return;
 	}
+
+	s_cache_expire(cc, time_s(), (size_t)-1);
 }
 
 /**
@@ -160,6 +478,24 @@ void cache_purge(cache_t *cc, int force)
   - **`VIGOR_CACHE_DESTRUCTOR`** - A destructor function, used
     for freeing memory of expired cache entries.
   - **`VIGOR_CACHE_EXPIRY`** - The global cache expiry.
+  - **`VIGOR_CACHE_EVICTION`** - Eviction policy (a pointer to an
+    `int`), for when @cache_set needs room for a new key in a full
+    cache.  `VIGOR_CACHE_EVICT_NONE` (the default) leaves it to the
+    caller, and @cache_set fails.  `VIGOR_CACHE_EVICT_LRU` evicts
+    the least recently used (set or retrieved) entry, calling the
+    destructor on its data.  `VIGOR_CACHE_EVICT_S3FIFO` uses the
+    scan-resistant S3-FIFO policy instead (see src/cache.c), which
+    keeps frequently used entries in the cache even when lots of
+    keys are only ever used once.
+  - **`VIGOR_CACHE_BUDGET`** - Total cost (a pointer to a `size_t`)
+    of all the entries in the cache, as given to @cache_set_cost,
+    or 0 (the default) for no limit.  If the cache is already over
+    the new budget, entries are evicted (if there is an eviction
+    policy) until it isn't.
+  - **`VIGOR_CACHE_ABSENT_EXPIRY`** - How long (in seconds, as an
+    `int`) negative entries set by @cache_set_absent live for.  It
+    defaults to the global cache expiry, but is usually shorter.
+    Only affects negative entries set afterwards.
 
   The $data payload will be cast to the appropriate data type,
   based on the given $op.
@@ -169,6 +505,7 @@ void cache_purge(cache_t *cc, int force)
   On failure, returns 1, and sets errno appropriately:
 
   - **`EINVAL`** - An unknown or unhandled $op value was specified.
+  - **`ENOMEM`** - Memory for the eviction policy could not be allocated.
  */
 int cache_setopt(cache_t *cc, int op, const void *data)
 {
@@ -178,19 +515,129 @@ int cache_setopt(cache_t *cc, int op, const void *data)
 	}
 	if (op == VIGOR_CACHE_EXPIRY) {
 		cc->expire = *(int*)(data) & 0xffffffff;
+
+		/* every entry's expiry just moved */
+		cache_entry_t *ent, *tmp;
+		size_t i;
+		LIST(all);
+		for (i = 0; i < CACHE_WHEEL_SLOTS; i++)
+			for_each_object_safe(ent, tmp, &cc->wheel[i], t) {
+				list_delete(&ent->t);
+				list_push(&all, &ent->t);
+			}
+		for_each_object_safe(ent, tmp, &all, t)
+			s_cache_schedule(cc, ent);
+		return 0;
+	}
+	if (op == VIGOR_CACHE_EVICTION) {
+		int evict = *(const int *)data;
+		if (evict != VIGOR_CACHE_EVICT_NONE
+		 && evict != VIGOR_CACHE_EVICT_LRU
+		 && evict != VIGOR_CACHE_EVICT_S3FIFO) {
+			errno = EINVAL;
+			return 1;
+		}
+
+		if (evict == VIGOR_CACHE_EVICT_S3FIFO && !cc->ghost.ring) {
+			cc->ghost.ring = calloc(cc->max_len ? cc->max_len : 1, sizeof(uint64_t));
+			if (!cc->ghost.ring) {
+				errno = ENOMEM;
+				return 1;
+			}
+
+		} else if (evict != VIGOR_CACHE_EVICT_S3FIFO) {
+			/* everything goes back to the one (main) queue */
+			cache_entry_t *ent, *tmp;
+			for_each_object_safe(ent, tmp, &cc->small, l) {
+				list_delete(&ent->l);
+				list_push(&cc->live, &ent->l);
+				ent->queue = CACHE_QUEUE_MAIN;
+			}
+			cc->nsmall = 0;
+			cc->csmall = 0;
+
+			ihash_done(&cc->ghost.index, 0);
+			free(cc->ghost.ring);
+			memset(&cc->ghost, 0, sizeof(cc->ghost));
+		}
+
+		cc->evict = evict;
+		return 0;
+	}
+	if (op == VIGOR_CACHE_ABSENT_EXPIRY) {
+		cc->absent_expire = *(const int *)data;
+		return 0;
+	}
+	if (op == VIGOR_CACHE_BUDGET) {
+		cc->max_cost = *(const size_t *)data;
+		while (cc->max_cost && cc->cost > cc->max_cost && s_cache_evict(cc))
+			;
 		return 0;
 	}
 	errno = EINVAL;
 	return 1;
 }
 
-static int s_cache_next(cache_t *cc)
+/* Does $cc need room before it can take a new entry costing $cost? */
+static inline int s_cache_full(cache_t *cc, size_t cost)
 {
-	int i;
-	for (i = 0; i < cc->max_len; i++)
-		if (!cc->entries[i].ident)
-			return i;
-	return -1;
+	return list_isempty(&cc->free)
+	    || (cc->max_cost && cc->cost + cost > cc->max_cost);
+}
+
+/* Take an unused entry (for new key $id, costing $cost) off the
+   free list, reclaiming expired entries (a few at a time), and
+   then evicting others, until there's room.  Returns NULL if the
+   cache is full, and nothing can be evicted. */
+static cache_entry_t* s_cache_next(cache_t *cc, const char *id, size_t cost)
+{
+	int32_t now = time_s();
+	size_t reclaimed = 0;
+
+	while (s_cache_full(cc, cost)) {
+		if (reclaimed < CACHE_RECLAIM_MAX && s_cache_expire(cc, now, 1) == 1) {
+			reclaimed++;
+			continue;
+		}
+		reclaimed = CACHE_RECLAIM_MAX; /* nothing (else) has expired */
+		if (!s_cache_evict(cc)) {
+			errno = ENOSPC;
+			return NULL;
+		}
+	}
+
+	list_t *l = list_shift(&cc->free);
+	cache_entry_t *ent = list_object(l, cache_entry_t, l);
+	if (cc->evict == VIGOR_CACHE_EVICT_S3FIFO
+	 && !(cc->index.seed && s_cache_ghosted(cc, s_cache_hash(cc, id)))) {
+		ent->queue = CACHE_QUEUE_SMALL;
+		list_push(&cc->small, l);
+		cc->nsmall++;
+		cc->csmall += cost;
+	} else {
+		list_push(&cc->live, l);
+	}
+	ent->cost = cost;
+	cc->cost += cost;
+	cc->len++;
+	cc->stats.inserts++;
+	return ent;
+}
+
+/* Record a hit on $ent, for the eviction policy. */
+static inline void s_cache_used(cache_t *cc, cache_entry_t *ent)
+{
+	switch (cc->evict) {
+	case VIGOR_CACHE_EVICT_LRU:
+		list_delete(&ent->l);
+		list_push(&cc->live, &ent->l);
+		break;
+
+	case VIGOR_CACHE_EVICT_S3FIFO:
+		if (ent->freq < CACHE_FREQ_MAX)
+			ent->freq++;
+		break;
+	}
 }
 
 /**
@@ -200,49 +647,196 @@ static int s_cache_next(cache_t *cc)
   If the object is found in the cache, its entry will be updated with
   the current access timestamp (to stave off expiration).
 
+  Entries that have expired are treated as misses (and reclaimed
+  on the spot), whether or not @cache_purge has gotten to them.
+
   Returns a pointer to the cached object if it is found, NULL if not.
+  For negative entries (see @cache_set_absent), returns the special
+  value `VIGOR_CACHE_ABSENT`.
  */
 void* cache_get(cache_t *cc, const char *id)
 {
 	cache_entry_t *ent = hash_get(&cc->index, id);
-	if (!ent) return NULL;
+	if (!ent) {
+		cc->stats.misses++;
+		return NULL;
+	}
 
 	int32_t now = time_s();
+	if (s_cache_expiry(cc, ent) <= now) {
+		cc->stats.misses++;
+		s_cache_expired(cc, ent);
+		return NULL;
+	}
+	cc->stats.hits++;
 	if (ent->last_seen < now)
-		ent->last_seen = time_s();
+		ent->last_seen = now;
 
+	s_cache_used(cc, ent);
 	return ent->data;
 }
 
+/* Insert or update $id, with deadline $expires (or 0), at $cost. */
+static cache_entry_t* s_cache_set(cache_t *cc, const char *id, void *data, int32_t expires, size_t cost)
+{
+	if (cc->max_cost && cost > cc->max_cost) {
+		cc->stats.rejected++;
+		errno = ENOSPC;
+		return NULL;
+	}
+
+	cache_entry_t *ent = hash_get(&cc->index, id);
+	if (ent && cc->max_cost && cc->cost - ent->cost + cost > cc->max_cost) {
+		if (cc->evict == VIGOR_CACHE_EVICT_NONE) {
+			/* nothing else can go to make room, so the update
+			   fails, and the entry keeps its old data */
+			cc->stats.rejected++;
+			errno = ENOSPC;
+			return NULL;
+		}
+		/* it grew, and others will have to go (which, since it
+		   fits in the budget on its own, eviction can always
+		   arrange); rather than shield it from the eviction
+		   policy, start it over */
+		void *d = s_cache_drop(cc, ent);
+		if (d != data)
+			s_cache_destroy(cc, d);
+		ent = NULL;
+	}
+	if (ent && ent->data != data)
+		s_cache_destroy(cc, ent->data);
+
+	if (!ent) {
+		ent = s_cache_next(cc, id, cost);
+		if (!ent) {
+			cc->stats.rejected++;
+			return NULL;
+		}
+	} else {
+		s_cache_used(cc, ent);
+		cc->cost = cc->cost - ent->cost + cost;
+		if (ent->queue == CACHE_QUEUE_SMALL)
+			cc->csmall = cc->csmall - ent->cost + cost;
+		ent->cost = cost;
+	}
+	ent->last_seen = time_s();
+	if (!ent->ident) {
+		ent->ident = strdup(id);
+		hash_set(&cc->index, id, ent);
+		list_init(&ent->t);
+		ent->expires = expires;
+		s_cache_schedule(cc, ent);
+
+	} else if (ent->expires || expires) {
+		/* deadline may have moved up */
+		ent->expires = expires;
+		s_cache_schedule(cc, ent);
+	}
+	ent->data = data;
+	return ent;
+}
+
 /**
   Stores $data in a cache, using the key $id.
 
   Updates or inserts a $data object into the cache, storing it under
   the cache key $id.  The access timestamp of the entry will be set to
-  the current timestamp.
+  the current timestamp.  The entry expires according to the global
+  cache expiry (see @cache_new), even if it previously had a TTL of
+  its own.
 
   On success, returns $data.  On failure, returns NULL.
 
   Failure could indicate that the cache is full.  This function does
-  not implicitly call @cache_purge; that is left to the caller.
+  not implicitly call @cache_purge; that is left to the caller.  If
+  an eviction policy has been set (see @cache_setopt), an entry will
+  be evicted to make room instead.  Either way, a few expired entries
+  will be reclaimed first, if there are any.
  */
 void* cache_set(cache_t *cc, const char *id, void *data)
 {
-	cache_entry_t *ent = hash_get(&cc->index, id);
-	if (ent && ent->data != data && cc->destroy_f)
-		(*cc->destroy_f)(ent->data);
+	return s_cache_set(cc, id, data, 0, 0) ? data : NULL;
+}
 
-	if (!ent) {
-		int idx = s_cache_next(cc);
-		if (idx < 0) return NULL;
-		ent = &cc->entries[idx];
-	}
-	if (!ent->ident) {
-		ent->ident = strdup(id);
-		hash_set(&cc->index, id, ent);
-	}
-	ent->last_seen = time_s();
-	return ent->data = data;
+/**
+  Stores $data in a cache, using the key $id, for $ttl seconds.
+
+  Works like @cache_set, except that the entry expires $ttl seconds
+  from now, whether it is accessed in the meantime or not, instead
+  of $expire seconds after it was last accessed.
+
+  On success, returns $data.  On failure, returns NULL.
+ */
+void* cache_set_ttl(cache_t *cc, const char *id, void *data, int32_t ttl)
+{
+	int64_t expires = (int64_t)time_s() + ttl + 1;
+	if (expires < 1) expires = 1; /* 0 means "no deadline" */
+	if (expires > INT32_MAX) expires = INT32_MAX;
+
+	return s_cache_set(cc, id, data, (int32_t)expires, 0) ? data : NULL;
+}
+
+/**
+  Stores $data in a cache, using the key $id, at a cost of $cost.
+
+  Works like @cache_set, except that the entry counts for $cost
+  (usually, the size of $data in bytes) against the cache's cost
+  budget (see `VIGOR_CACHE_BUDGET` under @cache_setopt).  If the
+  entry doesn't fit, others are evicted until it does; updating an
+  existing entry with a higher cost may evict it, too, in which case
+  it is set again as if it were new.  Entries set with @cache_set or
+  @cache_set_ttl cost nothing.
+
+  The number of entries is still capped at the size given to
+  @cache_new, whatever their cost.
+
+  On success, returns $data.  On failure, returns NULL, and sets
+  errno appropriately:
+
+  - **`ENOSPC`** - $cost is more than the budget, or there is no
+    room and no eviction policy has been set.  A failed update
+    leaves the existing entry (and its data) alone.
+ */
+void* cache_set_cost(cache_t *cc, const char *id, void *data, size_t cost)
+{
+	return s_cache_set(cc, id, data, 0, cost) ? data : NULL;
+}
+
+/**
+  Remember that nothing exists under the key $id.
+
+  Stores a negative entry (a tombstone) for $id, so that lookups
+  of keys that the backend doesn't have can be answered from the
+  cache too, instead of going to the backend every time.  Lookups
+  of a negative entry return `VIGOR_CACHE_ABSENT`, rather than
+  NULL (which still means "not cached"):
+
+      void *v = cache_get(cc, id);
+      if (v == VIGOR_CACHE_ABSENT)
+          return NULL;              // known not to exist
+      if (!v) {
+          v = fetch(id);
+          if (v) cache_set(cc, id, v);
+          else   cache_set_absent(cc, id);
+      }
+
+  Negative entries expire `VIGOR_CACHE_ABSENT_EXPIRY` seconds (see
+  @cache_setopt) after they are set, however often they are looked
+  up, so that keys which come into existence are noticed.  Setting
+  $id with @cache_set (or friends) replaces the negative entry.
+  Negative entries are never passed to the destructor, and are
+  left out of snapshots (see @cache_save).
+
+  On success, returns 0.  On failure (i.e. the cache is full),
+  returns -1, and sets errno (see @cache_set_cost).
+ */
+int cache_set_absent(cache_t *cc, const char *id)
+{
+	int64_t expires = (int64_t)time_s() + cc->absent_expire + 1;
+	if (expires < 1) expires = 1;
+	if (expires > INT32_MAX) expires = INT32_MAX;
+
+	return s_cache_set(cc, id, VIGOR_CACHE_ABSENT, (int32_t)expires, 0) ? 0 : -1;
 }
 
 /**
@@ -252,25 +846,390 @@ void* cache_set(cache_t *cc, const char *id, void *data)
   $id key.
 
   A pointer to the removed data object is returned to the caller if
-  possible.  If nothing is stored under that key, returns NULL.
+  possible.  If nothing is stored under that key (or it is a negative
+  entry; see @cache_set_absent), returns NULL.
  */
 void* cache_unset(cache_t *cc, const char *id)
 {
 	cache_entry_t *ent = hash_get(&cc->index, id);
 	if (!ent) return NULL;
-	hash_set(&cc->index, id, NULL);
 
-	free(ent->ident);
-	ent->ident = NULL;
+	/* FIXME: it seems like we should have no return,
+	          and just destroy the cache function... */
+	void *d = s_cache_drop(cc, ent);
+	return d == VIGOR_CACHE_ABSENT ? NULL : d;
+}
 
-	ent->last_seen = -1;
+/* A load in flight, shared by everyone waiting on it. */
+struct cache_load {
+	pthread_cond_t done_cv;
+	int            done;
+	void          *data;
+	int            error;   /* errno, if data is NULL */
+	size_t         waiters;
+};
 
-	void *d = ent->data;
-	ent->data = NULL;
+/**
+  Retrieve a value from the cache, loading it on a miss.
+
+  Works like @cache_get, except that on a miss, $load is called
+  (with $id and $ctx) to produce the object, which is then stored
+  with @cache_set and returned.  If other threads ask for the same
+  $id while it is being loaded, they wait for that load to finish
+  and get its result, rather than calling $load themselves; $load
+  is called once per miss, not once per caller.
+
+  $load runs without any locks held, so it is free to take its
+  time, and to use the cache (for other keys).  It should return
+  NULL (and set errno) on failure; failures are not cached, and
+  every caller waiting on the load gets NULL, with the same errno.
+
+  Calls to cache_get_or_load are serialized on `cc->lock`; other
+  threads using the cache directly (i.e. via @cache_get or
+  @cache_set) must hold it while they do.
+
+  On success, returns the cached (or newly loaded) object, which
+  may be `VIGOR_CACHE_ABSENT` if $id has a negative entry (see
+  @cache_set_absent).  On failure, returns NULL, and sets errno appropriately:
+
+  - **`ENOSPC`** - The object was loaded, but there was no room for
+    it in the cache; it has been passed to the destructor, if any.
+  - Anything else is passed through from $load.
+ */
+void* cache_get_or_load(cache_t *cc, const char *id, void* (*load)(const char*, void*), void *ctx)
+{
+	struct cache_load *fl;
+	void *data;
+	int error;
+
+	pthread_mutex_lock(&cc->lock);
+	data = cache_get(cc, id);
+	if (data) {
+		pthread_mutex_unlock(&cc->lock);
+		return data;
+	}
 
-	/* FIXME: it seems like we should have no return,
-	          and just destroy the cache function... */
-	return d;
+	fl = hash_get(&cc->loading, id);
+	if (fl) {
+		/* someone else is already loading it */
+		fl->waiters++;
+		while (!fl->done)
+			pthread_cond_wait(&fl->done_cv, &cc->lock);
+
+		data  = fl->data;
+		error = fl->error;
+		if (--fl->waiters == 0) {
+			pthread_cond_destroy(&fl->done_cv);
+			free(fl);
+		}
+		pthread_mutex_unlock(&cc->lock);
+
+		if (!data) errno = error;
+		return data;
+	}
+
+	fl = vcalloc(1, sizeof(struct cache_load));
+	pthread_cond_init(&fl->done_cv, NULL);
+	hash_set(&cc->loading, id, fl);
+	pthread_mutex_unlock(&cc->lock);
+
+	errno = 0;
+	data  = (*load)(id, ctx);
+	error = data ? 0 : errno;
+
+	pthread_mutex_lock(&cc->lock);
+	if (data && !cache_set(cc, id, data)) {
+		s_cache_destroy(cc, data);
+		data  = NULL;
+		error = ENOSPC;
+	}
+	hash_unset(&cc->loading, id);
+
+	fl->data  = data;
+	fl->error = error;
+	fl->done  = 1;
+	if (fl->waiters) {
+		pthread_cond_broadcast(&fl->done_cv);
+	} else {
+		pthread_cond_destroy(&fl->done_cv);
+		free(fl);
+	}
+	pthread_mutex_unlock(&cc->lock);
+
+	if (!data) errno = error;
+	return data;
+}
+
+/*
+  Cache snapshots (see @cache_save) start with a header, followed
+  by one record per entry, oldest (i.e. least recently used) first:
+
+      header:  "VIGORCC\0"  u32 byte-order mark  u32 version  u64 count
+      record:  i32 last_seen  i32 expires  u64 cost  u32 klen  u32 dlen
+               key (klen bytes, including its NUL terminator)
+               packed data (dlen bytes)
+               padding, to the next multiple of 8 bytes
+
+  Everything is in host byte order; snapshots are meant for warm
+  restarts on the same machine, not for shipping around.  Since
+  records are 8-byte aligned, @cache_load can use keys straight
+  out of a mapping of the file.
+ */
+#define CACHE_FILE_MAGIC   "VIGORCC"
+#define CACHE_FILE_BOM     0x01020304u
+#define CACHE_FILE_VERSION 1
+#define CACHE_FILE_PAD(n)  (((n) + 7) & ~(size_t)7)
+
+struct cache_file_header {
+	char     magic[8];
+	uint32_t bom;
+	uint32_t version;
+	uint64_t count;
+};
+
+struct cache_file_record {
+	int32_t  last_seen;
+	int32_t  expires;
+	uint64_t cost;
+	uint32_t klen;
+	uint32_t dlen;
+};
+
+/* Records are buffered, so that saving a big cache doesn't
+   cost a handful of write(2) calls per entry. */
+struct cache_out {
+	int     fd;
+	size_t  len;
+	uint8_t buf[65536];
+};
+
+static int s_cache_flush(struct cache_out *out)
+{
+	const uint8_t *p = out->buf;
+	while (out->len > 0) {
+		ssize_t n = write(out->fd, p, out->len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		p += n; out->len -= n;
+	}
+	return 0;
+}
+
+static int s_cache_write(struct cache_out *out, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	while (len > 0) {
+		if (out->len == sizeof(out->buf) && s_cache_flush(out) != 0)
+			return -1;
+
+		size_t n = sizeof(out->buf) - out->len;
+		if (n > len) n = len;
+		memcpy(out->buf + out->len, p, n);
+		out->len += n;
+		p += n; len -= n;
+	}
+	return 0;
+}
+
+/* Write the record for $ent to $out, packing its data into *$buf
+   (of *$cap bytes, grown as needed).  Returns 1 if the record was
+   written, 0 if $pack skipped it, and -1 on failure. */
+static int s_cache_save(cache_entry_t *ent, struct cache_out *out, ssize_t (*pack)(const void*, void*, size_t), uint8_t **buf, size_t *cap)
+{
+	static const uint8_t zero[8];
+	struct cache_file_record r;
+	ssize_t n;
+
+	for (;;) {
+		n = (*pack)(ent->data, *buf, *cap);
+		if (n < 0) return 0;
+		if ((size_t)n <= *cap) break;
+
+		uint8_t *b = realloc(*buf, n);
+		if (!b) {
+			errno = ENOMEM;
+			return -1;
+		}
+		*buf = b;
+		*cap = n;
+	}
+
+	memset(&r, 0, sizeof(r));
+	r.last_seen = ent->last_seen;
+	r.expires   = ent->expires;
+	r.cost      = ent->cost;
+	r.klen      = strlen(ent->ident) + 1;
+	r.dlen      = n;
+
+	size_t len = sizeof(r) + r.klen + r.dlen;
+	if (s_cache_write(out, &r, sizeof(r)) != 0
+	 || s_cache_write(out, ent->ident, r.klen) != 0
+	 || s_cache_write(out, *buf, r.dlen) != 0
+	 || s_cache_write(out, zero, CACHE_FILE_PAD(len) - len) != 0)
+		return -1;
+	return 1;
+}
+
+/**
+  Save a snapshot of cache $cc to file descriptor $fd.
+
+  Every live (unexpired) entry is written out, along with its key,
+  timestamps and cost, so that a freshly started process can warm
+  its cache up with @cache_load instead of going to the backends.
+
+  Objects are written out by calling $pack(data, buf, len), which
+  should serialize `data` into the `len` bytes at `buf`, and return
+  how many bytes it needs.  If that's more than `len`, $pack will
+  be called again, with a bigger buffer.  If it returns a negative
+  number, the entry is left out of the snapshot.
+
+  $fd should be a regular file, freshly opened (or truncated) for
+  writing; the snapshot starts at its current offset, and the
+  header is written last, with pwrite(2), so that a partially
+  written snapshot won't load.
+
+  On success, returns the number of entries saved.  On failure,
+  returns -1, and sets errno appropriately.
+ */
+ssize_t cache_save(cache_t *cc, int fd, ssize_t (*pack)(const void*, void*, size_t))
+{
+	struct cache_file_header hdr;
+	cache_entry_t *ent;
+	uint8_t *buf = NULL;
+	size_t cap = 0;
+	ssize_t n = 0;
+	int rc = 0;
+	int32_t now = time_s();
+
+	off_t start = lseek(fd, 0, SEEK_CUR);
+	if (start < 0) return -1;
+
+	struct cache_out *out = vmalloc(sizeof(struct cache_out));
+	out->fd = fd;
+
+	memset(&hdr, 0, sizeof(hdr));
+	rc = s_cache_write(out, &hdr, sizeof(hdr));
+
+	/* S3-FIFO's probationary entries are the oldest */
+	if (rc >= 0) {
+		for_each_object(ent, &cc->small, l) {
+			if (s_cache_expiry(cc, ent) <= now || ent->data == VIGOR_CACHE_ABSENT) continue;
+			if ((rc = s_cache_save(ent, out, pack, &buf, &cap)) < 0) break;
+			n += rc;
+		}
+	}
+	if (rc >= 0) {
+		for_each_object(ent, &cc->live, l) {
+			if (s_cache_expiry(cc, ent) <= now || ent->data == VIGOR_CACHE_ABSENT) continue;
+			if ((rc = s_cache_save(ent, out, pack, &buf, &cap)) < 0) break;
+			n += rc;
+		}
+	}
+	if (rc >= 0)
+		rc = s_cache_flush(out);
+	free(out);
+	free(buf);
+	if (rc < 0) return -1;
+
+	memcpy(hdr.magic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC));
+	hdr.bom     = CACHE_FILE_BOM;
+	hdr.version = CACHE_FILE_VERSION;
+	hdr.count   = n;
+	if (pwrite(fd, &hdr, sizeof(hdr), start) != sizeof(hdr))
+		return -1;
+
+	return n;
+}
+
+/**
+  Load a snapshot (see @cache_save) from $fd into cache $cc.
+
+  The snapshot is mapped into memory, rather than read, and keys
+  are inserted straight out of the mapping.  Each object is handed
+  to $unpack(buf, len), which should deserialize it and return a
+  new object (the `buf` goes away once cache_load returns), or NULL
+  to leave that entry out.
+
+  Entries keep the access timestamps, TTLs and costs they were
+  saved with, and the order they were saved in, so that a cache
+  with an eviction policy picks up where it left off.  Entries
+  that have expired since the snapshot was taken are skipped.  If
+  $cc fills up (and can't evict), the objects that don't fit are
+  passed to the destructor, if one is set.
+
+  On success, returns the number of entries loaded.  On failure,
+  returns -1, and sets errno appropriately:
+
+  - **`EINVAL`** - The snapshot is corrupt, truncated, or was
+    written on a machine with a different byte order.  Entries
+    loaded before the problem was found are kept.
+  - Anything else is passed through from fstat(2) or mmap(2).
+ */
+ssize_t cache_load(cache_t *cc, int fd, void* (*unpack)(const void*, size_t))
+{
+	const struct cache_file_header *hdr;
+	struct stat st;
+	ssize_t n = 0;
+	uint64_t i;
+
+	if (fstat(fd, &st) != 0)
+		return -1;
+	if ((size_t)st.st_size < sizeof(*hdr)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+
+	const uint8_t *p = map + sizeof(*hdr), *end = map + st.st_size;
+	hdr = (const struct cache_file_header *)map;
+	if (memcmp(hdr->magic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC)) != 0
+	 || hdr->bom != CACHE_FILE_BOM || hdr->version != CACHE_FILE_VERSION)
+		goto corrupt;
+
+	int32_t now = time_s();
+	for (i = 0; i < hdr->count; i++) {
+		const struct cache_file_record *r = (const struct cache_file_record *)p;
+		if ((size_t)(end - p) < sizeof(*r)
+		 || r->klen < 1
+		 || (size_t)(end - p) - sizeof(*r) < (size_t)r->klen + r->dlen)
+			goto corrupt;
+
+		const char *key  = (const char *)(r + 1);
+		const void *data = key + r->klen;
+		if (key[r->klen - 1] != '\0')
+			goto corrupt;
+		p += CACHE_FILE_PAD(sizeof(*r) + r->klen + r->dlen);
+		if (p > end) p = end;
+
+		if (r->expires ? r->expires <= now
+		               : (int64_t)r->last_seen + cc->expire + 1 <= now)
+			continue;
+
+		void *obj = (*unpack)(data, r->dlen);
+		if (!obj) continue;
+
+		cache_entry_t *ent = s_cache_set(cc, key, obj, r->expires, r->cost);
+		if (!ent) {
+			s_cache_destroy(cc, obj);
+			continue;
+		}
+		ent->last_seen = r->last_seen;
+		s_cache_schedule(cc, ent);
+		n++;
+	}
+
+	munmap(map, st.st_size);
+	return n;
+
+corrupt:
+	munmap(map, st.st_size);
+	errno = EINVAL;
+	return -1;
 }
 
 /**
@@ -279,6 +1238,9 @@ void* cache_unset(cache_t *cc, const char *id)
   Finds the cache entry stored under the $id key and updates its
   access timestamp to $last.  This can be used to prematurely expire
   an entry, or keep it in cache without accessing it.
+
+  Touching an entry that was set with @cache_set_ttl drops its
+  TTL; from then on, it expires like any other entry.
  */
 void cache_touch(cache_t *cc, const char *id, int32_t last)
 {
@@ -287,22 +1249,335 @@ void cache_touch(cache_t *cc, const char *id, int32_t last)
 
 	if (last <= 0) last = time_s();
 	ent->last_seen = last;
+	ent->expires = 0;
+	s_cache_schedule(cc, ent);
+}
+
+/**
+  Retrieve statistics for cache $cc, in $st.
+
+  The counters (hits, misses, inserts, evictions, expirations
+  and rejected sets) run from when the cache was created; the
+  occupancy fields (`len`, `max_len`, `cost` and `max_cost`)
+  describe the cache as it is now.  Hits and misses are only
+  counted by @cache_get (and @cache_get_or_load); peeking at the
+  index directly doesn't count.
+ */
+void cache_stats(cache_t *cc, cache_stats_t *st)
+{
+	*st = cc->stats;
+	st->len      = cc->len;
+	st->max_len  = cc->max_len;
+	st->cost     = cc->cost;
+	st->max_cost = cc->max_cost;
 }
 
+/**
+  Check if cache $cc is full (every entry is in use).
+
+  This is a constant-time check; the cache keeps track of
+  how many of its entries are in use.
+ */
 int cache_isfull(cache_t *cc)
 {
-	int i;
-	for (i = 0; i < cc->max_len; i++)
-		if (!cc->entries[i].ident)
-			return 0;
-	return 1;
+	return cc->len >= cc->max_len;
 }
 
+/**
+  Check if cache $cc is empty (no entry is in use).
+ */
 int cache_isempty(cache_t *cc)
 {
-	int i;
-	for (i = 0; i < cc->max_len; i++)
-		if (cc->entries[i].ident)
-			return 0;
-	return 1;
+	return cc->len == 0;
+}
+
+/*
+  A ccache_t spreads keys over a number of cache_t shards, each
+  behind its own read-write lock.  Updates lock one shard, and
+  lookups only take the read lock; instead of updating recency
+  directly (which would mean writing to the shard's lists), a hit
+  just sets the entry's access bit, and bumps its timestamp.  The
+  eviction policy picks the bits up the next time it runs: under
+  LRU, an entry at the head of the queue with its bit set gets a
+  second chance at the tail (a la CLOCK); under S3-FIFO, the bit
+  counts as a hit.
+ */
+#define CCACHE_DEFAULT_SHARDS 16
+
+/* Look up $id without changing $cc (other than the entry's
+   access bit and timestamp), for use under a shared lock. */
+static void* s_cache_peek(cache_t *cc, const char *id)
+{
+	cache_entry_t *ent = hash_get(&cc->index, id);
+	int32_t now = time_s();
+
+	if (!ent || s_cache_expiry(cc, ent) <= now) {
+		/* expired entries are left for s_cache_expire() */
+		__atomic_fetch_add(&cc->stats.misses, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	__atomic_fetch_add(&cc->stats.hits, 1, __ATOMIC_RELAXED);
+
+	if (__atomic_load_n(&ent->last_seen, __ATOMIC_RELAXED) < now)
+		__atomic_store_n(&ent->last_seen, now, __ATOMIC_RELAXED);
+	if (!__atomic_load_n(&ent->used, __ATOMIC_RELAXED))
+		__atomic_store_n(&ent->used, 1, __ATOMIC_RELAXED);
+	return ent->data;
+}
+
+static ccache_shard_t* s_ccache_shard(ccache_t *cc, const char *id)
+{
+	uint64_t hv = hash64(id, strlen(id), cc->seed);
+	return &cc->shards[(hv >> 32) & (cc->n - 1)];
+}
+
+/**
+  Create a new, thread-safe sharded cache.
+
+  Works like @cache_new, except that the $len entries are split
+  evenly across (at least) $shards independently locked caches,
+  and keys are spread across them by hash.  If $shards is 0, a
+  sensible default is used.  Lookups can proceed in parallel, and
+  updates only block other users of the one shard they touch.
+
+  Each shard is full when its share of $len is used up (and each
+  evicts on its own), so a sharded cache can fill up a little
+  before an unsharded one would.
+
+  As with @chash_new, it is up to the caller to make sure that an
+  object returned by @ccache_get isn't destroyed (i.e. evicted)
+  by another thread while it's still in use.
+
+  On success, returns a new `ccache_t`, which must be freed with
+  @ccache_free.  On failure, returns NULL.
+ */
+ccache_t* ccache_new(size_t len, int32_t expire, size_t shards)
+{
+	size_t i, n = 1;
+
+	if (!shards) shards = CCACHE_DEFAULT_SHARDS;
+	while (n < shards)
+		n <<= 1;
+
+	ccache_t *cc = calloc(1, sizeof(ccache_t));
+	if (!cc) return NULL;
+
+	if (posix_memalign((void **)&cc->shards, 64, n * sizeof(ccache_shard_t)) != 0) {
+		free(cc);
+		return NULL;
+	}
+	memset(cc->shards, 0, n * sizeof(ccache_shard_t));
+
+	cc->n    = n;
+	cc->seed = hash_seed();
+	for (i = 0; i < n; i++) {
+		pthread_rwlock_init(&cc->shards[i].lock, NULL);
+		cc->shards[i].cache = cache_new((len + n - 1) / n, expire);
+		if (!cc->shards[i].cache) {
+			cc->n = i + 1;
+			ccache_free(cc);
+			return NULL;
+		}
+	}
+	return cc;
+}
+
+/**
+  Release memory used by the sharded cache $cc.
+
+  No other thread may be using $cc.
+
+  It is _not_ an error to call ccache_free with a NULL pointer.
+ */
+void ccache_free(ccache_t *cc)
+{
+	size_t i;
+	if (!cc) return;
+
+	for (i = 0; i < cc->n; i++) {
+		cache_free(cc->shards[i].cache);
+		pthread_rwlock_destroy(&cc->shards[i].lock);
+	}
+	free(cc->shards);
+	free(cc);
+}
+
+/**
+  Purge expired entries from every shard of $cc.
+
+  See @cache_purge.  Each shard is locked in turn, so this
+  never blocks more than one shard at a time.
+ */
+void ccache_purge(ccache_t *cc, int force)
+{
+	size_t i;
+	for (i = 0; i < cc->n; i++) {
+		pthread_rwlock_wrlock(&cc->shards[i].lock);
+		cache_purge(cc->shards[i].cache, force);
+		pthread_rwlock_unlock(&cc->shards[i].lock);
+	}
+}
+
+/**
+  Set options on every shard of $cc.
+
+  See @cache_setopt; the same options are supported.  A
+  `VIGOR_CACHE_BUDGET` is split evenly across the shards.
+
+  On success, returns 0.  On failure, returns 1, and sets errno
+  (see @cache_setopt).
+ */
+int ccache_setopt(ccache_t *cc, int op, const void *value)
+{
+	size_t i, budget;
+	int rc = 0;
+
+	if (op == VIGOR_CACHE_BUDGET) {
+		budget = (*(const size_t *)value + cc->n - 1) / cc->n;
+		value = &budget;
+	}
+	for (i = 0; rc == 0 && i < cc->n; i++) {
+		pthread_rwlock_wrlock(&cc->shards[i].lock);
+		rc = cache_setopt(cc->shards[i].cache, op, value);
+		pthread_rwlock_unlock(&cc->shards[i].lock);
+	}
+	return rc;
+}
+
+/**
+  Retrieve a value from the sharded cache.
+
+  Works like @cache_get, but only takes a read lock on the shard
+  that $id lives in, so that concurrent hits don't contend (see
+  src/cache.c).  Expired entries are misses, but are left for the
+  next update or purge of the shard to reclaim.
+ */
+void* ccache_get(ccache_t *cc, const char *id)
+{
+	ccache_shard_t *s = s_ccache_shard(cc, id);
+	pthread_rwlock_rdlock(&s->lock);
+	void *data = s_cache_peek(s->cache, id);
+	pthread_rwlock_unlock(&s->lock);
+	return data;
+}
+
+/**
+  Store $data in the sharded cache, under the key $id.
+
+  See @cache_set.
+ */
+void* ccache_set(ccache_t *cc, const char *id, void *data)
+{
+	ccache_shard_t *s = s_ccache_shard(cc, id);
+	pthread_rwlock_wrlock(&s->lock);
+	data = cache_set(s->cache, id, data);
+	pthread_rwlock_unlock(&s->lock);
+	return data;
+}
+
+/**
+  Store $data in the sharded cache, under the key $id, for $ttl
+  seconds.
+
+  See @cache_set_ttl.
+ */
+void* ccache_set_ttl(ccache_t *cc, const char *id, void *data, int32_t ttl)
+{
+	ccache_shard_t *s = s_ccache_shard(cc, id);
+	pthread_rwlock_wrlock(&s->lock);
+	data = cache_set_ttl(s->cache, id, data, ttl);
+	pthread_rwlock_unlock(&s->lock);
+	return data;
+}
+
+/**
+  Store $data in the sharded cache, under the key $id, at a cost
+  of $cost.
+
+  See @cache_set_cost.  The budget is per-shard, so $cost must fit
+  in the shard's share of it.
+ */
+void* ccache_set_cost(ccache_t *cc, const char *id, void *data, size_t cost)
+{
+	ccache_shard_t *s = s_ccache_shard(cc, id);
+	pthread_rwlock_wrlock(&s->lock);
+	data = cache_set_cost(s->cache, id, data, cost);
+	pthread_rwlock_unlock(&s->lock);
+	return data;
+}
+
+/**
+  Store a negative entry for $id in the sharded cache.
+
+  See @cache_set_absent.
+ */
+int ccache_set_absent(ccache_t *cc, const char *id)
+{
+	ccache_shard_t *s = s_ccache_shard(cc, id);
+	pthread_rwlock_wrlock(&s->lock);
+	int rc = cache_set_absent(s->cache, id);
+	pthread_rwlock_unlock(&s->lock);
+	return rc;
+}
+
+/**
+  Remove the entry stored under $id from the sharded cache.
+
+  See @cache_unset.
+ */
+void* ccache_unset(ccache_t *cc, const char *id)
+{
+	ccache_shard_t *s = s_ccache_shard(cc, id);
+	pthread_rwlock_wrlock(&s->lock);
+	void *data = cache_unset(s->cache, id);
+	pthread_rwlock_unlock(&s->lock);
+	return data;
+}
+
+/**
+  Count the live entries in $cc.
+
+  Since other threads may be updating $cc, the result is
+  only a snapshot, and may be stale by the time it returns.
+ */
+size_t ccache_len(ccache_t *cc)
+{
+	size_t i, n = 0;
+	for (i = 0; i < cc->n; i++) {
+		pthread_rwlock_rdlock(&cc->shards[i].lock);
+		n += cc->shards[i].cache->len;
+		pthread_rwlock_unlock(&cc->shards[i].lock);
+	}
+	return n;
+}
+
+/**
+  Retrieve statistics for sharded cache $cc, in $st.
+
+  See @cache_stats; the counters and occupancy of all the shards
+  are added up.  As with @ccache_len, the result is a snapshot.
+ */
+void ccache_stats(ccache_t *cc, cache_stats_t *st)
+{
+	cache_stats_t s;
+	size_t i;
+
+	memset(st, 0, sizeof(*st));
+	for (i = 0; i < cc->n; i++) {
+		/* hits and misses are bumped under the read lock */
+		pthread_rwlock_wrlock(&cc->shards[i].lock);
+		cache_stats(cc->shards[i].cache, &s);
+		pthread_rwlock_unlock(&cc->shards[i].lock);
+
+		st->hits        += s.hits;
+		st->misses      += s.misses;
+		st->inserts     += s.inserts;
+		st->evictions   += s.evictions;
+		st->expirations += s.expirations;
+		st->rejected    += s.rejected;
+		st->len         += s.len;
+		st->max_len     += s.max_len;
+		st->cost        += s.cost;
+		st->max_cost    += s.max_cost;
+	}
 }
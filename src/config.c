@@ -32,6 +32,20 @@
 
  */
 
+static void s_config_key(keyval_t *kv, const char *key, intern_t *pool)
+{
+	kv->interned = pool != NULL;
+	kv->key = kv->interned ? (char *)intern(pool, key) : strdup(key);
+}
+
+static void s_config_free(keyval_t *kv)
+{
+	if (!kv->interned)
+		free(kv->key);
+	free(kv->val);
+	free(kv);
+}
+
 /**
   Set a configuration directive.
 
@@ -42,13 +56,33 @@
   Returns 0 on success.
  */
 int config_set(config_t *cfg, const char *key, const char *val)
+{
+	return config_set_interned(cfg, key, val, NULL);
+}
+
+/**
+  Set a configuration directive, interning its key.
+
+  Works just like @config_set, except that if $key is not yet set
+  in $cfg, it is interned in $pool (which must outlive $cfg)
+  instead of being copied.  Interned keys can be compared by
+  address; lookups with the canonical copy of a key skip the
+  string comparison.  Passing a NULL $pool copies $key.
+
+  Only intern keys from a small, fixed vocabulary (i.e. the
+  directives a program understands); interned strings are never
+  freed.
+
+  Returns 0 on success.
+ */
+int config_set_interned(config_t *cfg, const char *key, const char *val, intern_t *pool)
 {
 	assert(key);
 	assert(val);
 
 	keyval_t *kv;
 	for_each_object(kv, cfg, l) {
-		if (strcmp(kv->key, key) != 0)
+		if (kv->key != key && strcmp(kv->key, key) != 0)
 			continue;
 		free(kv->val);
 		kv->val = strdup(val);
@@ -58,7 +92,7 @@ int config_set(config_t *cfg, const char *key, const char *val)
 	kv = malloc(sizeof(keyval_t));
 	assert(kv);
 
-	kv->key = strdup(key);
+	s_config_key(kv, key, pool);
 	kv->val = strdup(val);
 	list_unshift(cfg, &kv->l);
 	return 0;
@@ -78,12 +112,10 @@ int config_unset(config_t *cfg, const char *key)
 
 	keyval_t *kv, *tmp;
 	for_each_object_safe(kv, tmp, cfg, l) {
-		if (strcmp(kv->key, key) != 0)
+		if (kv->key != key && strcmp(kv->key, key) != 0)
 			continue;
 		list_delete(&kv->l);
-		free(kv->key);
-		free(kv->val);
-		free(kv);
+		s_config_free(kv);
 	}
 	return 0;
 }
@@ -101,7 +133,7 @@ char * config_get(config_t *cfg, const char *key)
 
 	keyval_t *kv;
 	for_each_object(kv, cfg, l)
-		if (strcmp(kv->key, key) == 0)
+		if (kv->key == key || strcmp(kv->key, key) == 0)
 			return kv->val;
 	return NULL;
 }
@@ -119,7 +151,7 @@ int config_isset(config_t *cfg, const char *key)
 
 	keyval_t *kv;
 	for_each_object(kv, cfg, l)
-		if (strcmp(kv->key, key) == 0)
+		if (kv->key == key || strcmp(kv->key, key) == 0)
 			return 1;
 	return 0;
 }
@@ -135,6 +167,21 @@ int config_isset(config_t *cfg, const char *key)
   Returns 0 on success.
  */
 int config_read(config_t *cfg, FILE *io)
+{
+	return config_read_interned(cfg, io, NULL);
+}
+
+/**
+  Read configuration from an input stream, interning its keys.
+
+  Works just like @config_read, except that keys are interned in
+  $pool (which must outlive $cfg), as per @config_set_interned.
+  The same caveat applies: don't use this to read files whose
+  keys are arbitrary data.
+
+  Returns 0 on success.
+ */
+int config_read_interned(config_t *cfg, FILE *io, intern_t *pool)
 {
 	assert(cfg);
 	assert(io);
@@ -176,7 +223,7 @@ int config_read(config_t *cfg, FILE *io)
 
 		kv = malloc(sizeof(keyval_t));
 		assert(kv);
-		kv->key = strdup(a);
+		s_config_key(kv, a, pool);
 		kv->val = strdup(c);
 
 		list_unshift(cfg, &kv->l);
@@ -220,9 +267,7 @@ void config_done(config_t *cfg)
 
 	keyval_t *kv, *tmp;
 	for_each_object_safe(kv, tmp, cfg, l) {
-		free(kv->key);
-		free(kv->val);
 		list_delete(&kv->l);
-		free(kv);
+		s_config_free(kv);
 	}
 }
@@ -20,40 +20,363 @@
 #include <vigor.h>
 #include "impl.h"
 
-static uint8_t s_hash64(const char *s)
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+/*
+  Each slot in the table has a one-byte control code, kept in
+  a separate array so that a whole group of them can be checked
+  at once.  Full slots store the low 7 bits of the key's hash;
+  empty and deleted slots have the high bit set.  Lookups only
+  strcmp() keys whose 7-bit fragment matched.
+ */
+#define HASH_CTRL_EMPTY   0x80
+#define HASH_CTRL_DELETED 0xfe
+#define HASH_CTRL_FULL(c) (!((c) & 0x80))
+
+#define HASH_GROUP     16
+#define HASH_MIN_SLOTS HASH_GROUP
+
+/* Smallest VIGOR_HASH_INCREMENTAL step.  A new table starts out
+   at most half full, and (being at least as big as the old one)
+   only gets old.cap / HASH_MIN_STEP more inserts before the old
+   table is drained; with a step of 4, that's under 3/4 full, so
+   it never reaches the 7/8 load limit mid-migration, which would
+   force s_hash_reserve() to finish the migration all at once. */
+#define HASH_MIN_STEP  4
+
+#define HASH_H1(x) ((x) >> 7)
+#define HASH_H2(x) ((uint8_t)((x) & 0x7f))
+
+/*
+  The default hash function is an in-tree implementation of
+  wyhash (https://github.com/wangyi-fudan/wyhash), which is
+  fast on short keys and mixes all 64 bits well.  Every table
+  gets its own seed, derived from a per-process random secret,
+  so that peers can't precompute keys that all collide.
+ */
+static const uint64_t WYP[4] = {
+	0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+	0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+
+static inline void s_wymum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = *a;
+	r *= *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl, lo, hi;
+	lo = t + (rm1 << 32); c += lo < t;
+	hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+	*a = lo;
+	*b = hi;
+#endif
+}
+
+static inline uint64_t s_wymix(uint64_t a, uint64_t b)
+{
+	s_wymum(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t s_wyr8(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t s_wyr4(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t s_wyr3(const uint8_t *p, size_t k)
+{
+	return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+/**
+  Hash $len bytes at $key, using $seed.
+
+  This is the default hash function for hash_t, and may be
+  useful elsewhere.  Results are only stable within the same
+  architecture; don't store them.
+ */
+uint64_t hash64(const void *key, size_t len, uint64_t seed)
+{
+	const uint8_t *p = key;
+	uint64_t a, b;
+
+	seed ^= s_wymix(seed ^ WYP[0], WYP[1]);
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (s_wyr4(p) << 32) | s_wyr4(p + ((len >> 3) << 2));
+			b = (s_wyr4(p + len - 4) << 32) | s_wyr4(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = s_wyr3(p, len);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = len;
+		if (i > 48) {
+			uint64_t see1 = seed, see2 = seed;
+			do {
+				seed = s_wymix(s_wyr8(p)      ^ WYP[1], s_wyr8(p + 8)  ^ seed);
+				see1 = s_wymix(s_wyr8(p + 16) ^ WYP[2], s_wyr8(p + 24) ^ see1);
+				see2 = s_wymix(s_wyr8(p + 32) ^ WYP[3], s_wyr8(p + 40) ^ see2);
+				p += 48; i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = s_wymix(s_wyr8(p) ^ WYP[1], s_wyr8(p + 8) ^ seed);
+			p += 16; i -= 16;
+		}
+		a = s_wyr8(p + i - 16);
+		b = s_wyr8(p + i - 8);
+	}
+
+	a ^= WYP[1];
+	b ^= seed;
+	s_wymum(&a, &b);
+	return s_wymix(a ^ WYP[0] ^ len, b ^ WYP[1]);
+}
+
+static pthread_once_t HASH_SECRET_ONCE = PTHREAD_ONCE_INIT;
+static uint64_t HASH_SECRET;
+static uint64_t HASH_TABLES;
+
+static void s_hash_secret(void)
+{
+	int fd = open("/dev/urandom", O_RDONLY);
+	if (fd < 0 || read(fd, &HASH_SECRET, sizeof(HASH_SECRET)) != sizeof(HASH_SECRET))
+		HASH_SECRET = (uint64_t)time_ms() ^ ((uint64_t)getpid() << 32);
+	if (fd >= 0) close(fd);
+}
+
+/* Pick a fresh, unpredictable seed for a new table. */
+static uint64_t s_hash_seed(void)
+{
+	pthread_once(&HASH_SECRET_ONCE, s_hash_secret);
+	uint64_t n = __sync_add_and_fetch(&HASH_TABLES, 1);
+	return hash64(&n, sizeof(n), HASH_SECRET) | 1;
+}
+
+uint64_t hash_seed(void)
+{
+	return s_hash_seed();
+}
+
+static inline uint64_t s_hash(const hash_t *h, const void *k, size_t len)
 {
-	unsigned int h = 81;
-	unsigned char c;
+	return (h->hashfn ? h->hashfn : hash64)(k, len, h->seed);
+}
+
+/*
+  The same engine backs hash_t (NUL-terminated string keys),
+  bhash_t (arbitrary byte string keys) and ihash_t (uint64_t
+  keys).  Internally, every key is a (pointer, length) pair;
+  integer keys are stored in the slot itself, rather than
+  being copied elsewhere.
+ */
+#define HASH_KEYS_STRING 0
+#define HASH_KEYS_BYTES  1
+#define HASH_KEYS_INT    2
 
-	while ((c = *s++))
-		h = ((h << 5) + h) + c;
+/* Only string keys are interned (see s_hash_insert); binary
+   keys are still copied, even with VIGOR_HASH_INTERN set. */
+#define s_hash_interns_keys(h) ((h)->intern && (h)->keys == HASH_KEYS_STRING)
+#define s_hash_owns_keys(h) (!(h)->arena && !s_hash_interns_keys(h) && (h)->keys != HASH_KEYS_INT)
 
-	return h & ~0xc0;
+static inline int s_slot_is(const hash_t *h, const struct hash_slot *s, uint64_t hv, const void *k, size_t len)
+{
+	if (s->hash != hv)
+		return 0;
+	if (h->keys == HASH_KEYS_INT)
+		return s->ikey == *(const uint64_t *)k;
+	return s->klen == len && (s->key == k || !len || memcmp(s->key, k, len) == 0);
 }
 
-static ssize_t s_hash_index(const struct hash_bkt *b, const char *k)
+/* Bitmask of the slots in the group starting at $ctrl whose
+   control byte is $c; bit N is set for a match on slot N. */
+static inline unsigned int s_group_match(const uint8_t *ctrl, uint8_t c)
 {
-	ssize_t i;
-	for (i = 0; i < b->len; i++)
-		if (strcmp(b->keys[i], k) == 0)
-			return i;
-	return (ssize_t)-1;
+#ifdef __SSE2__
+	__m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)c)));
+#else
+	unsigned int i, m = 0;
+	for (i = 0; i < HASH_GROUP; i++)
+		if (ctrl[i] == c)
+			m |= 1u << i;
+	return m;
+#endif
 }
 
-static int s_hash_insert(struct hash_bkt *b, const char *k, void *v)
+/* Find the slot in $t holding $k, or the slot that $k should
+   be inserted into (preferring the first deleted slot seen along
+   the probe sequence).  $t->cap must be non-zero.
+
+   Probing walks whole groups of HASH_GROUP slots, triangularly,
+   so that every group is visited once the table is full. */
+static size_t s_table_probe(const hash_t *h, const struct hash_table *t, const void *k, size_t len, uint64_t hv, int *found)
 {
-	if (!k) return 1;
+	size_t gmask = t->cap / HASH_GROUP - 1;
+	size_t g     = HASH_H1(hv) & gmask;
+	size_t step  = 0;
+	ssize_t tomb = -1;
 
-	char ** new_k = realloc(b->keys,   (b->len + 1) * sizeof(char*));
-	char ** new_v = realloc(b->values, (b->len + 1) * sizeof(void*));
+	for (;;) {
+		const uint8_t *ctrl = t->ctrl + g * HASH_GROUP;
+		unsigned int m;
 
-	new_k[b->len] = strdup(k);
-	new_v[b->len] = v;
+		m = s_group_match(ctrl, HASH_H2(hv));
+		while (m) {
+			size_t i = g * HASH_GROUP + __builtin_ctz(m);
+			if (s_slot_is(h, &t->slots[i], hv, k, len)) {
+				*found = 1;
+				return i;
+			}
+			m &= m - 1;
+		}
 
-	b->keys   = new_k;
-	b->values = new_v;
-	b->len++;
+		if (tomb < 0 && (m = s_group_match(ctrl, HASH_CTRL_DELETED)) != 0)
+			tomb = g * HASH_GROUP + __builtin_ctz(m);
 
+		m = s_group_match(ctrl, HASH_CTRL_EMPTY);
+		if (m) {
+			*found = 0;
+			return tomb < 0 ? g * HASH_GROUP + __builtin_ctz(m) : (size_t)tomb;
+		}
+
+		g = (g + ++step) & gmask;
+	}
+}
+
+/* Find the first free slot in $t for a key known not to be
+   there, skipping the key comparisons. */
+static size_t s_table_free_slot(const struct hash_table *t, uint64_t hv)
+{
+	size_t gmask = t->cap / HASH_GROUP - 1;
+	size_t g     = HASH_H1(hv) & gmask;
+	size_t step  = 0;
+
+	for (;;) {
+		unsigned int m = s_group_match(t->ctrl + g * HASH_GROUP, HASH_CTRL_EMPTY)
+		               | s_group_match(t->ctrl + g * HASH_GROUP, HASH_CTRL_DELETED);
+		if (m)
+			return g * HASH_GROUP + __builtin_ctz(m);
+
+		g = (g + ++step) & gmask;
+	}
+}
+
+/* Fill the free slot $i of $t with a copy of $s. */
+static void s_table_put(struct hash_table *t, size_t i, const struct hash_slot *s)
+{
+	if (t->ctrl[i] == HASH_CTRL_EMPTY)
+		t->used++;
+	t->ctrl[i]  = HASH_H2(s->hash);
+	t->slots[i] = *s;
+}
+
+/* Mark slot $i of $t as free; the key is the caller's problem. */
+static void s_table_clear(struct hash_table *t, size_t i)
+{
+	t->slots[i].key   = NULL;
+	t->slots[i].value = NULL;
+
+	/* if this slot's group still has an empty slot, no probe
+	   has ever walked past it, and the slot can be emptied
+	   outright rather than left as a tombstone. */
+	if (s_group_match(t->ctrl + (i & ~(HASH_GROUP - 1)), HASH_CTRL_EMPTY)) {
+		t->ctrl[i] = HASH_CTRL_EMPTY;
+		t->used--;
+	} else {
+		t->ctrl[i] = HASH_CTRL_DELETED;
+	}
+}
+
+/* Allocate the slot and control arrays for $cap slots, as
+   a single block; the control bytes follow the slots. */
+static int s_table_alloc(struct hash_table *t, size_t cap)
+{
+	struct hash_slot *slots = malloc(cap * (sizeof(struct hash_slot) + 1));
+	if (!slots)
+		return -1;
+
+	t->slots = slots;
+	t->ctrl  = (uint8_t *)(slots + cap);
+	t->cap   = cap;
+	t->used  = 0;
+	memset(t->ctrl, HASH_CTRL_EMPTY, cap);
+	return 0;
+}
+
+/* Look $k up in both the current table, and the one being
+   migrated away from (if any), returning the table it was
+   found in, or NULL. */
+static struct hash_table* s_hash_find(const hash_t *h, const void *k, size_t len, uint64_t hv, size_t *i)
+{
+	int found;
+	if (h->tab.cap) {
+		*i = s_table_probe(h, &h->tab, k, len, hv, &found);
+		if (found) return (struct hash_table *)&h->tab;
+	}
+	if (h->old.cap) {
+		*i = s_table_probe(h, &h->old, k, len, hv, &found);
+		if (found) return (struct hash_table *)&h->old;
+	}
+	return NULL;
+}
+
+/* Move live keys from the next $n slots of the old table into
+   the current one, freeing the old table once it's drained. */
+static void s_hash_migrate(hash_t *h, size_t n)
+{
+	while (h->old.cap && n--) {
+		size_t i = h->migrated++;
+		if (HASH_CTRL_FULL(h->old.ctrl[i])) {
+			struct hash_slot *s = &h->old.slots[i];
+			s_table_put(&h->tab, s_table_free_slot(&h->tab, s->hash), s);
+			s_table_clear(&h->old, i);
+		}
+
+		if (h->migrated == h->old.cap) {
+			free(h->old.slots);
+			memset(&h->old, 0, sizeof(h->old));
+			h->migrated = 0;
+		}
+	}
+}
+
+/* Make room for one more key, keeping the load factor of the
+   current table (live keys and deleted slots alike) at or
+   below 7/8.  When it fills up, a table big enough for twice
+   as many keys replaces it, and the keys are moved over all
+   at once, or $h->step slots per update (see hash_setopt). */
+static int s_hash_reserve(hash_t *h)
+{
+	if ((h->tab.used + 1) * 8 <= h->tab.cap * 7)
+		return 0;
+
+	s_hash_migrate(h, h->old.cap);
+
+	size_t cap = h->tab.cap ? h->tab.cap : HASH_MIN_SLOTS;
+	while ((h->len + 1) * 2 > cap)
+		cap <<= 1;
+
+	struct hash_table t;
+	if (s_table_alloc(&t, cap) != 0)
+		return -1;
+
+	h->old = h->tab;
+	h->tab = t;
+	h->migrated = 0;
+	if (!h->old.cap) {
+		memset(&h->old, 0, sizeof(h->old));
+	} else if (!h->step) {
+		s_hash_migrate(h, h->old.cap);
+	}
 	return 0;
 }
 
@@ -69,6 +392,95 @@ static int s_hash_insert(struct hash_bkt *b, const char *k, void *v)
 
  */
 
+/**
+  Set hash options.
+
+  The following $op values are supported:
+
+  - **`VIGOR_HASH_FUNCTION`** - A `hash_fn` to use in place of
+    the default @hash64.  Passing NULL restores the default.
+  - **`VIGOR_HASH_SEED`** - A pointer to the `uint64_t` seed to
+    pass to the hash function.  A zero seed (the default) means
+    a random seed will be chosen when the first key is set.
+  - **`VIGOR_HASH_INCREMENTAL`** - A pointer to a `size_t` count
+    of slots.  When the hash outgrows its table, keys will be
+    moved to the new, larger table a few at a time; each insert
+    or removal moves the keys in the next that-many slots of the
+    old table.  Lookups consult both tables in the meantime.
+    Zero (the default) moves all keys at once.  Non-zero counts
+    below 4 are rounded up to 4, which guarantees that the old
+    table is drained before the new one fills up (and would have
+    to finish the migration in one go).
+  - **`VIGOR_HASH_ARENA`** - A pointer to an `int`; if non-zero,
+    keys will be copied into large, shared blocks of memory owned
+    by the hash, instead of each being `strdup`'d.  The memory is
+    only reclaimed (all at once) by @hash_done, which makes this
+    best suited to hashes that are built up, used and then thrown
+    away, rather than ones with a lot of key churn.
+
+  - **`VIGOR_HASH_INTERN`** - An `intern_t` pool (or NULL, to
+    stop); keys will be interned in the pool, rather than being
+    copied.  Keys returned by @hash_next and friends are then the
+    pool's canonical copies, and can be compared by address.
+    Takes precedence over `VIGOR_HASH_ARENA`.  Only applies to
+    string keys; bhash_t keys are still copied.
+
+  The hash function, seed, arena and intern pool can only be
+  changed while $h is empty.  Note that @hash_done resets all
+  options to their defaults.
+
+  On success, returns 0.
+
+  On failure, returns 1, and sets errno appropriately:
+
+  - **`EBUSY`** - $h already has keys in it.
+  - **`ENOMEM`** - The arena could not be allocated.
+  - **`EINVAL`** - An unknown or unhandled $op value was specified.
+ */
+int hash_setopt(hash_t *h, int op, const void *value)
+{
+	assert(h); // LCOV_EXCL_LINE
+
+	if (op == VIGOR_HASH_INCREMENTAL) {
+		h->step = *(const size_t *)value;
+		if (h->step && h->step < HASH_MIN_STEP)
+			h->step = HASH_MIN_STEP;
+		if (!h->step)
+			s_hash_migrate(h, h->old.cap);
+		return 0;
+	}
+
+	if (h->len) {
+		errno = EBUSY;
+		return 1;
+	}
+	if (op == VIGOR_HASH_FUNCTION) {
+		h->hashfn = (hash_fn)value;
+		return 0;
+	}
+	if (op == VIGOR_HASH_SEED) {
+		h->seed = *(const uint64_t *)value;
+		return 0;
+	}
+	if (op == VIGOR_HASH_ARENA) {
+		arena_free(h->arena);
+		h->arena = NULL;
+		if (*(const int *)value && !(h->arena = arena_new(0))) {
+			errno = ENOMEM;
+			return 1;
+		}
+		return 0;
+	}
+	if (op == VIGOR_HASH_INTERN) {
+		h->intern = (void *)value;
+		return 0;
+	}
+	errno = EINVAL;
+	return 1;
+}
+
+static const struct hash_slot* s_hash_walk(const hash_t *h, size_t *pos);
+
 /**
   Release memory allocated to hash $h.
 
@@ -80,19 +492,140 @@ static int s_hash_insert(struct hash_bkt *b, const char *k, void *v)
  */
 void hash_done(hash_t *h, uint8_t all)
 {
-	ssize_t i, j;
+	const struct hash_slot *s;
+	size_t pos = 0;
 	if (h) {
-		for (i = 0; i < 64; i++) {
-			for (j = 0; j < h->entries[i].len; j++) {
-				free(h->entries[i].keys[j]);
-				if (all) free(h->entries[i].values[j]);
+		/* walk the slots directly; hash_next() stops at the
+		   first NULL key, which is what ihash_t key 0 looks like */
+		if (all || s_hash_owns_keys(h)) {
+			while ((s = s_hash_walk(h, &pos)) != NULL) {
+				if (s_hash_owns_keys(h)) free(s->key);
+				if (all) free(s->value);
 			}
-			free(h->entries[i].keys);
-			free(h->entries[i].values);
 		}
+		arena_free(h->arena);
+		free(h->tab.slots);
+		free(h->old.slots);
+		memset(h, 0, sizeof(hash_t));
 	}
 }
 
+static void* s_hash_get(const hash_t *h, const void *k, size_t len)
+{
+	if (!h->len) return NULL;
+
+	size_t i;
+	struct hash_table *t = s_hash_find(h, k, len, s_hash(h, k, len), &i);
+	return t ? t->slots[i].value : NULL;
+}
+
+/* Insert the (new) key $k, with hash $hv, returning its slot. */
+static struct hash_slot* s_hash_insert(hash_t *h, const void *k, size_t len, uint64_t hv, void *v)
+{
+	s_hash_migrate(h, h->step);
+	if (s_hash_reserve(h) != 0)
+		return NULL;
+
+	struct hash_slot s = { .hash = hv, .klen = len, .value = v };
+	if (h->keys == HASH_KEYS_INT) {
+		s.ikey = *(const uint64_t *)k;
+	} else if (s_hash_interns_keys(h)) {
+		s.key = (char *)intern_n(h->intern, k, len);
+		if (!s.key) return NULL;
+	} else {
+		/* string keys keep (i.e. get) their NUL terminator */
+		size_t n = len + (h->keys == HASH_KEYS_STRING);
+		s.key = h->arena ? arena_alloc(h->arena, n ? n : 1) : malloc(n ? n : 1);
+		if (!s.key) return NULL;
+		if (len) memcpy(s.key, k, len);
+		if (n > len) s.key[len] = '\0';
+	}
+
+	size_t i = s_table_free_slot(&h->tab, hv);
+	s_table_put(&h->tab, i, &s);
+	h->len++;
+	return &h->tab.slots[i];
+}
+
+static void* s_hash_set(hash_t *h, const void *k, size_t len, void *v)
+{
+	if (!h->seed)
+		h->seed = s_hash_seed();
+
+	size_t i;
+	uint64_t hv = s_hash(h, k, len);
+	struct hash_table *t = s_hash_find(h, k, len, hv, &i);
+
+	if (t) {
+		void *existing = t->slots[i].value;
+		t->slots[i].value = v;
+		return existing;
+	}
+
+	return s_hash_insert(h, k, len, hv, v) ? v : NULL;
+}
+
+/* internal use; see src/intern.c */
+const char* hash_intern(hash_t *h, const char *k, size_t len, int create)
+{
+	assert(h); // LCOV_EXCL_LINE
+	assert(k); // LCOV_EXCL_LINE
+
+	/* lookups (!$create) must not modify $h at all */
+	if (!h->len && !create)
+		return NULL;
+	if (!h->seed)
+		h->seed = s_hash_seed();
+
+	size_t i;
+	uint64_t hv = s_hash(h, k, len);
+	struct hash_table *t = s_hash_find(h, k, len, hv, &i);
+	if (t)
+		return t->slots[i].key;
+	if (!create)
+		return NULL;
+
+	struct hash_slot *s = s_hash_insert(h, k, len, hv, NULL);
+	if (!s) return NULL;
+	return s->value = s->key;
+}
+
+static void* s_hash_unset(hash_t *h, const void *k, size_t len)
+{
+	if (!h->len) return NULL;
+
+	size_t i;
+	struct hash_table *t = s_hash_find(h, k, len, s_hash(h, k, len), &i);
+	if (!t) {
+		return NULL;
+	}
+
+	void *existing = t->slots[i].value;
+	if (s_hash_owns_keys(h)) free(t->slots[i].key);
+	s_table_clear(t, i);
+	h->len--;
+
+	s_hash_migrate(h, h->step);
+	return existing;
+}
+
+/* Find the next slot at or after position *$pos in $h, walking
+   the old table (if any) first, then the current one. */
+static const struct hash_slot* s_hash_walk(const hash_t *h, size_t *pos)
+{
+	while (*pos < h->old.cap + h->tab.cap) {
+		const struct hash_table *t = &h->old;
+		size_t i = (*pos)++;
+		if (i >= h->old.cap) {
+			t = &h->tab;
+			i -= h->old.cap;
+		}
+		if (HASH_CTRL_FULL(t->ctrl[i]))
+			return &t->slots[i];
+	}
+	return NULL;
+}
+
 /**
   Retrieve the value of $k from $h.
 
@@ -101,10 +634,7 @@ void hash_done(hash_t *h, uint8_t all)
 void* hash_get(const hash_t *h, const char *k)
 {
 	if (!h || !k) return NULL;
-
-	const struct hash_bkt *b = &h->entries[s_hash64(k)];
-	ssize_t i = s_hash_index(b, k);
-	return (i < 0 ? NULL : b->values[i]);
+	return s_hash_get(h, k, strlen(k));
 }
 
 /**
@@ -119,19 +649,7 @@ void* hash_get(const hash_t *h, const char *k)
 void* hash_set(hash_t *h, const char *k, void *v)
 {
 	if (!h || !k) return NULL;
-
-	struct hash_bkt *b = &h->entries[s_hash64(k)];
-	ssize_t i = s_hash_index(b, k);
-
-	if (i < 0) {
-		if(s_hash_insert(b, k, v) == 0)
-			h->len++;
-		return v;
-	}
-
-	void *existing = b->values[i];
-	b->values[i] = v;
-	return existing;
+	return s_hash_set(h, k, strlen(k), v);
 }
 
 /**
@@ -143,22 +661,7 @@ void* hash_set(hash_t *h, const char *k, void *v)
  */
 void* hash_unset(hash_t *h, const char *k) {
 	if (!h || !k) return NULL;
-
-	struct hash_bkt *b = &h->entries[s_hash64(k)];
-	ssize_t i = s_hash_index(b, k);
-	if (i < 0) {
-		return NULL;
-	}
-
-	void *existing = b->values[i];
-	ssize_t j;
-	for (j = i + 1; j < b->len; i++, j++) {
-		b->keys[i]   = b->keys[j];
-		b->values[i] = b->values[j];
-	}
-	h->len--;
-	b->len--;
-	return existing;
+	return s_hash_unset(h, k, strlen(k));
 }
 
 /* internal use; external visibility for macro loops */
@@ -166,34 +669,369 @@ void* hash_next(hash_t *h, char **k, void **v)
 {
 	assert(h); // LCOV_EXCL_LINE
 
-	char *tmp = NULL;
-	if (k) *k = NULL;
-	if (v) *v = NULL;
-	while (h->bucket < 64) {
-		struct hash_bkt *b = h->entries + h->bucket;
-		if (h->offset >= b->len) {
-			h->bucket++;
-			h->offset = 0;
-			continue;
-		}
-		tmp = b->keys[h->offset];
-		if (k) *k = b->keys[h->offset];
-		if (v) *v = b->values[h->offset];
-		h->offset++;
-		break;
-	}
-	return tmp;
+	size_t pos = h->bucket;
+	const struct hash_slot *s = s_hash_walk(h, &pos);
+	h->bucket = pos;
+
+	if (k) *k = s ? s->key   : NULL;
+	if (v) *v = s ? s->value : NULL;
+	return s ? s->key : NULL;
+}
+
+/**
+  Advance the external iterator $it.
+
+  Unlike @hash_next, which keeps its place in the hash itself,
+  the position is kept in $it, and the hash is left untouched.
+  Several iterators (in nested loops, or in different threads)
+  can therefore walk the same hash at the same time, as long as
+  nobody modifies it in the meantime.
+
+  Usually called via the `for_each_key_value_iter` macro:
+
+  <code>
+  hash_iter_t it;
+  char *k; void *v;
+  for_each_key_value_iter(it, h, k, v) {
+      ...
+  }
+  </code>
+
+  Returns the next key (setting $k and $v), or NULL once every
+  key has been visited.
+ */
+void* hash_iter_next(hash_iter_t *it, char **k, void **v)
+{
+	assert(it);       // LCOV_EXCL_LINE
+	assert(it->hash); // LCOV_EXCL_LINE
+
+	const struct hash_slot *s = s_hash_walk(it->hash, &it->pos);
+	if (k) *k = s ? s->key   : NULL;
+	if (v) *v = s ? s->value : NULL;
+	return s ? s->key : NULL;
 }
 
 /**
   Merge hash $b into $a, overwriting values in $a.
  */
-void hash_merge(hash_t *a, hash_t *b)
+void hash_merge(hash_t *a, const hash_t *b)
 {
 	assert(a); // LCOV_EXCL_LINE;
 	assert(b); // LCOV_EXCL_LINE;
 
+	hash_iter_t it;
 	char *k; void *v;
-	for_each_key_value(b, k, v)
+	for_each_key_value_iter(it, b, k, v)
 		hash_set(a, k, v);
 }
+
+/*
+  Integer-keyed hashes store their uint64_t keys directly in
+  the slot, and hash the eight bytes of the key as-is; there
+  is no formatting, and nothing to copy or free.
+ */
+
+/**
+  Set option $op on integer-keyed hash $h.
+
+  Accepts the same options, with the same semantics, as
+  @hash_setopt.  Note that a custom VIGOR_HASH_FUNCTION will
+  be given a pointer to the 8-byte key.
+ */
+int ihash_setopt(ihash_t *h, int op, const void *value)
+{
+	assert(h); // LCOV_EXCL_LINE
+	return hash_setopt(&h->h, op, value);
+}
+
+/**
+  Free the memory used by integer-keyed hash $h.
+
+  If $all is non-zero, the values stored in $h will be
+  freed as well; see @hash_done.
+ */
+void ihash_done(ihash_t *h, uint8_t all)
+{
+	if (h) hash_done(&h->h, all);
+}
+
+/**
+  Retrieve the value of $k from $h.
+
+  If $k is not found in $h, NULL is returned.
+ */
+void* ihash_get(const ihash_t *h, uint64_t k)
+{
+	if (!h) return NULL;
+	return s_hash_get(&h->h, &k, sizeof(k));
+}
+
+/**
+  Set the value of $k in $h to $v.
+
+  Works just like @hash_set; returns the prior value if $k
+  was already set, and $v if not.
+ */
+void* ihash_set(ihash_t *h, uint64_t k, void *v)
+{
+	if (!h) return NULL;
+	h->h.keys = HASH_KEYS_INT;
+	return s_hash_set(&h->h, &k, sizeof(k), v);
+}
+
+/**
+  Unset the key $k in $h, returning its value (if any).
+ */
+void* ihash_unset(ihash_t *h, uint64_t k)
+{
+	if (!h) return NULL;
+	return s_hash_unset(&h->h, &k, sizeof(k));
+}
+
+/**
+  Advance the external iterator $it, over an integer-keyed hash.
+
+  Usually called via the `for_each_ihash_key_value` macro.
+  Returns 1 (setting $k and $v) if there was another key to
+  visit, or 0 once every key has been visited.
+ */
+int ihash_iter_next(hash_iter_t *it, uint64_t *k, void **v)
+{
+	assert(it);       // LCOV_EXCL_LINE
+	assert(it->hash); // LCOV_EXCL_LINE
+
+	const struct hash_slot *s = s_hash_walk(it->hash, &it->pos);
+	if (!s) return 0;
+	if (k) *k = s->ikey;
+	if (v) *v = s->value;
+	return 1;
+}
+
+/*
+  Binary-keyed hashes accept any (pointer, length) byte string
+  as a key, including ones with embedded NUL bytes (like ZeroMQ
+  peer identities).  Keys are copied in on insert, just as with
+  hash_t, but lookups and removals use the caller's buffer as-is.
+ */
+
+/**
+  Set option $op on binary-keyed hash $h.
+
+  Accepts the same options, with the same semantics, as
+  @hash_setopt.
+ */
+int bhash_setopt(bhash_t *h, int op, const void *value)
+{
+	assert(h); // LCOV_EXCL_LINE
+	return hash_setopt(&h->h, op, value);
+}
+
+/**
+  Free the memory used by binary-keyed hash $h.
+
+  If $all is non-zero, the values stored in $h will be
+  freed as well; see @hash_done.
+ */
+void bhash_done(bhash_t *h, uint8_t all)
+{
+	if (h) hash_done(&h->h, all);
+}
+
+/**
+  Retrieve the value of the $len-byte key $k from $h.
+
+  If $k is not found in $h, NULL is returned.
+ */
+void* bhash_get(const bhash_t *h, const void *k, size_t len)
+{
+	if (!h || (!k && len)) return NULL;
+	return s_hash_get(&h->h, k, len);
+}
+
+/**
+  Set the value of the $len-byte key $k in $h to $v.
+
+  Works just like @hash_set; returns the prior value if $k
+  was already set, and $v if not.
+ */
+void* bhash_set(bhash_t *h, const void *k, size_t len, void *v)
+{
+	if (!h || (!k && len)) return NULL;
+	h->h.keys = HASH_KEYS_BYTES;
+	return s_hash_set(&h->h, k, len, v);
+}
+
+/**
+  Unset the $len-byte key $k in $h, returning its value (if any).
+ */
+void* bhash_unset(bhash_t *h, const void *k, size_t len)
+{
+	if (!h || (!k && len)) return NULL;
+	return s_hash_unset(&h->h, k, len);
+}
+
+/**
+  Advance the external iterator $it, over a binary-keyed hash.
+
+  Usually called via the `for_each_bhash_key_value` macro.
+  Returns 1 (setting $k, $len and $v) if there was another key
+  to visit, or 0 once every key has been visited.  Keys are
+  owned by the hash, and must not be modified or freed.
+ */
+int bhash_iter_next(hash_iter_t *it, const void **k, size_t *len, void **v)
+{
+	assert(it);       // LCOV_EXCL_LINE
+	assert(it->hash); // LCOV_EXCL_LINE
+
+	const struct hash_slot *s = s_hash_walk(it->hash, &it->pos);
+	if (!s) return 0;
+	if (k)   *k   = s->key;
+	if (len) *len = s->klen;
+	if (v)   *v   = s->value;
+	return 1;
+}
+
+/*
+  Concurrent hashes spread their keys across a power-of-two
+  number of shards, each an ordinary hash_t behind its own
+  reader/writer lock.  Shards are cache-line aligned, so that
+  threads working in different shards don't contend at all.
+ */
+
+#define CHASH_DEFAULT_SHARDS 64
+
+static chash_shard_t* s_chash_shard(chash_t *ch, const char *k)
+{
+	uint64_t hv = hash64(k, strlen(k), ch->seed);
+	return &ch->shards[(hv >> 32) & (ch->n - 1)];
+}
+
+/**
+  Create a new, thread-safe concurrent hash.
+
+  Keys are spread across (at least) $shards independently locked
+  sub-hashes; lookups in the same shard can proceed in parallel,
+  while updates only block other users of that one shard.  If
+  $shards is 0, a sensible default is used.
+
+  Keys are copied, as with hash_t; values are not, and it is up
+  to the caller to make sure that a value returned by @chash_get
+  isn't freed by another thread while it's still in use.
+
+  On success, returns a new `chash_t`, which must be freed with
+  @chash_free.  On failure, returns NULL.
+ */
+chash_t* chash_new(size_t shards)
+{
+	size_t i, n = 1;
+
+	if (!shards) shards = CHASH_DEFAULT_SHARDS;
+	while (n < shards)
+		n <<= 1;
+
+	chash_t *ch = calloc(1, sizeof(chash_t));
+	if (!ch) return NULL;
+
+	if (posix_memalign((void **)&ch->shards, 64, n * sizeof(chash_shard_t)) != 0) {
+		free(ch);
+		return NULL;
+	}
+	memset(ch->shards, 0, n * sizeof(chash_shard_t));
+
+	ch->n    = n;
+	ch->seed = s_hash_seed();
+	for (i = 0; i < n; i++)
+		pthread_rwlock_init(&ch->shards[i].lock, NULL);
+
+	return ch;
+}
+
+/**
+  Free concurrent hash $ch.
+
+  If $all is non-zero, values stored in the hash will be freed
+  as well, as with @hash_done.  No other thread may be using $ch.
+
+  It is _not_ an error to call chash_free with a NULL pointer.
+ */
+void chash_free(chash_t *ch, uint8_t all)
+{
+	size_t i;
+	if (!ch) return;
+
+	for (i = 0; i < ch->n; i++) {
+		hash_done(&ch->shards[i].hash, all);
+		pthread_rwlock_destroy(&ch->shards[i].lock);
+	}
+	free(ch->shards);
+	free(ch);
+}
+
+/**
+  Retrieve the value of $k from $ch.
+
+  If $k is not found in $ch, NULL is returned.
+ */
+void* chash_get(chash_t *ch, const char *k)
+{
+	if (!ch || !k) return NULL;
+
+	chash_shard_t *s = s_chash_shard(ch, k);
+	pthread_rwlock_rdlock(&s->lock);
+	void *v = hash_get(&s->hash, k);
+	pthread_rwlock_unlock(&s->lock);
+	return v;
+}
+
+/**
+  Set the value of $k in $ch to $v.
+
+  Works just like @hash_set; returns the prior value if $k
+  was already set, and $v if not.
+ */
+void* chash_set(chash_t *ch, const char *k, void *v)
+{
+	if (!ch || !k) return NULL;
+
+	chash_shard_t *s = s_chash_shard(ch, k);
+	pthread_rwlock_wrlock(&s->lock);
+	v = hash_set(&s->hash, k, v);
+	pthread_rwlock_unlock(&s->lock);
+	return v;
+}
+
+/**
+  Unset the key $k in $ch.
+
+  Works just like @hash_unset; returns the removed value,
+  or NULL if $k wasn't set.
+ */
+void* chash_unset(chash_t *ch, const char *k)
+{
+	if (!ch || !k) return NULL;
+
+	chash_shard_t *s = s_chash_shard(ch, k);
+	pthread_rwlock_wrlock(&s->lock);
+	void *v = hash_unset(&s->hash, k);
+	pthread_rwlock_unlock(&s->lock);
+	return v;
+}
+
+/**
+  Count the keys in $ch.
+
+  Since other threads may be updating $ch, the result is
+  only a snapshot, and may be stale by the time it returns.
+ */
+size_t chash_len(chash_t *ch)
+{
+	size_t i, n = 0;
+	if (!ch) return 0;
+
+	for (i = 0; i < ch->n; i++) {
+		pthread_rwlock_rdlock(&ch->shards[i].lock);
+		n += hash_len(&ch->shards[i].hash);
+		pthread_rwlock_unlock(&ch->shards[i].lock);
+	}
+	return n;
+}
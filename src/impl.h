@@ -23,6 +23,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 
 #include <assert.h>
@@ -45,4 +46,19 @@
 
 #include <sodium.h>
 
+/* internal bump allocator, for objects that are freed all
+   at once (i.e. the keys of a hash_t); see src/mem.c */
+typedef struct arena arena_t;
+arena_t* arena_new(size_t chunk);
+void* arena_alloc(arena_t *a, size_t len);
+char* arena_strdup(arena_t *a, const char *s);
+void arena_free(arena_t *a);
+
+/* canonical copy of the $len-byte string $k in $h, which is
+   inserted if not found (and $create is set); see src/intern.c */
+const char* hash_intern(hash_t *h, const char *k, size_t len, int create);
+
+/* fresh, unpredictable hash64() seed (i.e. for picking shards) */
+uint64_t hash_seed(void);
+
 #endif
@@ -0,0 +1,184 @@
+/*
+  Copyright 2016 James Hunt <james@jameshunt.us>
+
+  This file is part of libvigor.
+
+  libvigor is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libvigor is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libvigor.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vigor.h>
+#include "impl.h"
+
+/*
+
+    #### ##    ## ######## ######## ########  ##    ##
+     ##  ###   ##    ##    ##       ##     ## ###   ##
+     ##  ####  ##    ##    ##       ##     ## ####  ##
+     ##  ## ## ##    ##    ######   ########  ## ## ##
+     ##  ##  ####    ##    ##       ##   ##   ##  ####
+     ##  ##   ###    ##    ##       ##    ##  ##   ###
+    #### ##    ##    ##    ######## ##     ## ##    ##
+
+ */
+
+/*
+  An intern pool keeps exactly one copy of each distinct string
+  it is given, in an arena-backed hash_t.  Two strings interned
+  in the same pool are equal if (and only if) their canonical
+  pointers are, so callers can swap strcmp() for `==`.
+
+  Interned strings live as long as the pool does; there is no
+  way to remove one.  Pools are meant for small, long-lived
+  vocabularies (PDU types, configuration keys, field names),
+  not for arbitrary user data.
+ */
+
+static intern_t       *GLOBAL_POOL;
+static pthread_once_t  GLOBAL_POOL_ONCE = PTHREAD_ONCE_INIT;
+
+static void s_global_pool(void)
+{
+	GLOBAL_POOL = intern_new();
+	assert(GLOBAL_POOL); // LCOV_EXCL_LINE
+}
+
+/**
+  Create a new, thread-safe string intern pool.
+
+  On success, returns a new `intern_t`, which must be freed with
+  @intern_free.  On failure, returns NULL.
+ */
+intern_t* intern_new(void)
+{
+	int on = 1;
+	intern_t *pool = calloc(1, sizeof(intern_t));
+	if (!pool) return NULL;
+
+	if (hash_setopt(&pool->strings, VIGOR_HASH_ARENA, &on) != 0) {
+		free(pool);
+		return NULL;
+	}
+	pthread_rwlock_init(&pool->lock, NULL);
+	return pool;
+}
+
+/**
+  Free intern pool $pool, and every string interned in it.
+
+  Any canonical pointers handed out by the pool (and any
+  hash_t, config_t or pdu_t using it) become invalid.  The
+  global pool (see @intern_global) must never be freed.
+
+  It is _not_ an error to call intern_free with a NULL pointer.
+ */
+void intern_free(intern_t *pool)
+{
+	if (!pool) return;
+	assert(pool != GLOBAL_POOL); // LCOV_EXCL_LINE
+
+	hash_done(&pool->strings, 0);
+	pthread_rwlock_destroy(&pool->lock);
+	free(pool);
+}
+
+/**
+  Retrieve the process-wide intern pool.
+
+  The pool is created on first use, and lives until the
+  process exits.
+ */
+intern_t* intern_global(void)
+{
+	pthread_once(&GLOBAL_POOL_ONCE, s_global_pool);
+	return GLOBAL_POOL;
+}
+
+/**
+  Intern the string $s in $pool.
+
+  Returns the canonical copy of $s, adding it to $pool if this
+  is the first time it has been seen.  The returned string must
+  not be modified or freed.  Returns NULL if $s is NULL, or if
+  memory could not be allocated.
+ */
+const char* intern(intern_t *pool, const char *s)
+{
+	if (!s) return NULL;
+	return intern_n(pool, s, strlen(s));
+}
+
+/**
+  Intern the first $len bytes of $s in $pool.
+
+  Works just like @intern, except that $s does not need to be
+  NUL-terminated (i.e. it can point into a PDU frame); the
+  canonical copy always is.
+ */
+const char* intern_n(intern_t *pool, const void *s, size_t len)
+{
+	assert(pool); // LCOV_EXCL_LINE
+	if (!s) return NULL;
+
+	pthread_rwlock_rdlock(&pool->lock);
+	const char *c = hash_intern(&pool->strings, s, len, 0);
+	pthread_rwlock_unlock(&pool->lock);
+	if (c) return c;
+
+	pthread_rwlock_wrlock(&pool->lock);
+	c = hash_intern(&pool->strings, s, len, 1);
+	pthread_rwlock_unlock(&pool->lock);
+	return c;
+}
+
+/**
+  Look up the canonical copy of $s in $pool, without adding it.
+
+  Returns NULL if $s has not been interned in $pool.
+ */
+const char* intern_find(intern_t *pool, const char *s)
+{
+	if (!s) return NULL;
+	return intern_find_n(pool, s, strlen(s));
+}
+
+/**
+  Look up the canonical copy of the first $len bytes of $s in
+  $pool, without adding it.
+
+  Works just like @intern_find, except that $s does not need
+  to be NUL-terminated.
+ */
+const char* intern_find_n(intern_t *pool, const void *s, size_t len)
+{
+	assert(pool); // LCOV_EXCL_LINE
+	if (!s) return NULL;
+
+	pthread_rwlock_rdlock(&pool->lock);
+	const char *c = hash_intern(&pool->strings, s, len, 0);
+	pthread_rwlock_unlock(&pool->lock);
+	return c;
+}
+
+/**
+  Return the number of distinct strings interned in $pool.
+ */
+size_t intern_len(intern_t *pool)
+{
+	assert(pool); // LCOV_EXCL_LINE
+
+	pthread_rwlock_rdlock(&pool->lock);
+	size_t n = hash_len(&pool->strings);
+	pthread_rwlock_unlock(&pool->lock);
+	return n;
+}
@@ -0,0 +1,35 @@
+/* generated by phash-gen from src/log-facilities.keys; do not edit */
+
+static const char *LOG_FACILITIES_keys[8] = {
+	"local7",
+	"local3",
+	"local4",
+	"local0",
+	"local1",
+	"local5",
+	"local6",
+	"local2",
+};
+
+static const int LOG_FACILITIES_values[8] = {
+	LOG_LOCAL7,
+	LOG_LOCAL3,
+	LOG_LOCAL4,
+	LOG_LOCAL0,
+	LOG_LOCAL1,
+	LOG_LOCAL5,
+	LOG_LOCAL6,
+	LOG_LOCAL2,
+};
+
+static const uint32_t LOG_FACILITIES_disp[5] = {
+	0x00000004, 0x00000000, 0x00000000, 0x00010000, 0x00000005,
+};
+
+static const phash_t LOG_FACILITIES = {
+	.seed = 0x9e3779b97f4a7c15ull,
+	.n    = 8,
+	.nb   = 5,
+	.disp = LOG_FACILITIES_disp,
+	.keys = LOG_FACILITIES_keys,
+};
@@ -0,0 +1,44 @@
+/* generated by phash-gen from src/log-levels.keys; do not edit */
+
+static const char *LOG_LEVELS_keys[12] = {
+	"warn",
+	"crit",
+	"alert",
+	"emerg",
+	"debug",
+	"critical",
+	"emergency",
+	"warning",
+	"err",
+	"notice",
+	"info",
+	"error",
+};
+
+static const int LOG_LEVELS_values[12] = {
+	LOG_WARNING,
+	LOG_CRIT,
+	LOG_ALERT,
+	LOG_EMERG,
+	LOG_DEBUG,
+	LOG_CRIT,
+	LOG_EMERG,
+	LOG_WARNING,
+	LOG_ERR,
+	LOG_NOTICE,
+	LOG_INFO,
+	LOG_ERR,
+};
+
+static const uint32_t LOG_LEVELS_disp[7] = {
+	0x00000000, 0x00000008, 0x00000000, 0x00000002, 0x00000005, 0x00000001,
+	0x00000000,
+};
+
+static const phash_t LOG_LEVELS = {
+	.seed = 0x9e3779b97f4a7c15ull,
+	.n    = 12,
+	.nb   = 7,
+	.disp = LOG_LEVELS_disp,
+	.keys = LOG_LEVELS_keys,
+};
@@ -20,6 +20,10 @@
 #include <vigor.h>
 #include "impl.h"
 
+/* generated by phash-gen, from src/log-*.keys */
+#include "log-levels.h"
+#include "log-facilities.h"
+
 /*
 
     ##        #######   ######    ######
@@ -67,15 +71,8 @@ void log_open(const char *ident, const char *facility)
 		return;
 	}
 
-	int fac = strcmp(facility, "local0") == 0 ? LOG_LOCAL0
-	        : strcmp(facility, "local1") == 0 ? LOG_LOCAL1
-	        : strcmp(facility, "local2") == 0 ? LOG_LOCAL2
-	        : strcmp(facility, "local3") == 0 ? LOG_LOCAL3
-	        : strcmp(facility, "local4") == 0 ? LOG_LOCAL4
-	        : strcmp(facility, "local5") == 0 ? LOG_LOCAL5
-	        : strcmp(facility, "local6") == 0 ? LOG_LOCAL6
-	        : strcmp(facility, "local7") == 0 ? LOG_LOCAL7
-	        :                                   LOG_DAEMON;
+	int i = phash_find(&LOG_FACILITIES, facility);
+	int fac = i < 0 ? LOG_DAEMON : LOG_FACILITIES_values[i];
 
 	LIBVIGOR_LOG.console = NULL;
 	closelog();
@@ -128,20 +125,8 @@ const char* log_level_name(int level)
 
 int log_level_number(const char *name)
 {
-	if (!name) return -1;
-	return   strcmp(name, "emerg")     == 0 ? LOG_EMERG
-	       : strcmp(name, "emergency") == 0 ? LOG_EMERG
-	       : strcmp(name, "alert")     == 0 ? LOG_ALERT
-	       : strcmp(name, "crit")      == 0 ? LOG_CRIT
-	       : strcmp(name, "critical")  == 0 ? LOG_CRIT
-	       : strcmp(name, "err")       == 0 ? LOG_ERR
-	       : strcmp(name, "error")     == 0 ? LOG_ERR
-	       : strcmp(name, "warn")      == 0 ? LOG_WARNING
-	       : strcmp(name, "warning")   == 0 ? LOG_WARNING
-	       : strcmp(name, "notice")    == 0 ? LOG_NOTICE
-	       : strcmp(name, "info")      == 0 ? LOG_INFO
-	       : strcmp(name, "debug")     == 0 ? LOG_DEBUG
-	       : -1;
+	int i = phash_find(&LOG_LEVELS, name);
+	return i < 0 ? -1 : LOG_LEVELS_values[i];
 }
 
 void logger(int level, const char *fmt, ...)
@@ -41,3 +41,83 @@ void* mem_vmalloc(size_t size, const char *func, const char *file, unsigned int
 	                 func, file, line, strerror(errno));
 	exit(42);
 }
+
+/*
+  Arenas hand out memory from a list of chunks, each twice the
+  size of the last (up to ARENA_MAX_CHUNK), and free it all in
+  one go.  Individual allocations can't be freed.
+ */
+
+#define ARENA_MIN_CHUNK 4096
+#define ARENA_MAX_CHUNK (1024 * 1024)
+#define ARENA_ALIGN     sizeof(void *)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t              len;
+	size_t              used;
+	char                data[];
+};
+
+struct arena {
+	struct arena_chunk *chunks; /* newest first */
+	size_t              next;   /* size of the next chunk */
+};
+
+arena_t* arena_new(size_t chunk)
+{
+	arena_t *a = calloc(1, sizeof(arena_t));
+	if (!a) return NULL;
+
+	a->next = chunk < ARENA_MIN_CHUNK ? ARENA_MIN_CHUNK : chunk;
+	return a;
+}
+
+void* arena_alloc(arena_t *a, size_t len)
+{
+	assert(a); // LCOV_EXCL_LINE
+
+	struct arena_chunk *c = a->chunks;
+	len = (len + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (!c || c->len - c->used < len) {
+		size_t n = a->next;
+		while (n < len)
+			n <<= 1;
+
+		c = malloc(sizeof(struct arena_chunk) + n);
+		if (!c) return NULL;
+
+		c->len  = n;
+		c->used = 0;
+		c->next = a->chunks;
+		a->chunks = c;
+
+		if (a->next < ARENA_MAX_CHUNK)
+			a->next <<= 1;
+	}
+
+	void *p = c->data + c->used;
+	c->used += len;
+	return p;
+}
+
+char* arena_strdup(arena_t *a, const char *s)
+{
+	size_t n = strlen(s) + 1;
+	char *p = arena_alloc(a, n);
+	if (p) memcpy(p, s, n);
+	return p;
+}
+
+void arena_free(arena_t *a)
+{
+	struct arena_chunk *c, *next;
+	if (!a) return;
+
+	for (c = a->chunks; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+	free(a);
+}
@@ -332,6 +332,28 @@ char* pdu_peer(pdu_t *p)
 	return p->peer;
 }
 
+/**
+  Retrieve the raw (binary) address of the peer that sent $p.
+
+  Unlike @pdu_peer, the address isn't encoded or copied; the
+  returned pointer is only valid for as long as $p is, and is
+  suitable for use as a bhash_t key.  Its length is stored in
+  $len.  Returns NULL (and sets $len to 0) if $p has no
+  return address.
+ */
+const void* pdu_address(pdu_t *p, size_t *len)
+{
+	assert(p);
+	assert(len);
+
+	if (!p->address) {
+		*len = 0;
+		return NULL;
+	}
+	*len = s_frame_size(p->address);
+	return s_frame_data(p->address);
+}
+
 char* pdu_type(pdu_t *p)
 {
 	if (!p->type)
@@ -339,6 +361,41 @@ char* pdu_type(pdu_t *p)
 	return p->type;
 }
 
+/**
+  Retrieve the type of PDU $p, as interned in $pool.
+
+  Works just like @pdu_type, except that if the type is already
+  interned in $pool (which must outlive $p), the canonical copy
+  is returned, rather than a freshly allocated string.  Handlers
+  can intern the types they know about up front, and then
+  dispatch by comparing types by address, instead of with
+  strcmp().
+
+  PDU types are never added to $pool; they come from the remote
+  peer, and interning them would let peers grow the pool (which
+  never shrinks) without limit.  Types not found in $pool are
+  copied, as usual.  A NULL $pool copies the type.
+ */
+char* pdu_type_interned(pdu_t *p, intern_t *pool)
+{
+	if (pool && !p->itype) {
+		char *canon = NULL;
+		if (p->type) {
+			canon = (char *)intern_find(pool, p->type);
+		} else {
+			frame_t *f = s_pdu_frame(p, 0);
+			if (f)
+				canon = (char *)intern_find_n(pool, s_frame_data(f), s_frame_size(f));
+		}
+		if (canon) {
+			free(p->type);
+			p->type  = canon;
+			p->itype = 1;
+		}
+	}
+	return pdu_type(p);
+}
+
 int pdu_attn(pdu_t *p, const char *peer)
 {
 	if (p->peer)
@@ -365,7 +422,8 @@ void pdu_free(pdu_t *p)
 
 	s_frame_free(p->address);
 	free(p->peer);
-	free(p->type);
+	if (!p->itype)
+		free(p->type);
 
 	frame_t *f, *f_tmp;
 	for_each_object_safe(f, f_tmp, &p->frames, l)
@@ -585,8 +643,9 @@ int pdu_from_hash(pdu_t *p, hash_t *h)
 	assert(p);
 	assert(h);
 
+	hash_iter_t it;
 	char *k, *v;
-	for_each_key_value(h, k, v) {
+	for_each_key_value_iter(it, h, k, v) {
 		pdu_extend(p, k, strlen(k));
 		pdu_extend(p, v, strlen(v));
 	}
@@ -209,29 +209,71 @@ char* interpolate(const char *str, hash_t *vars)
 }
 
 #define STRINGS_INIT_LEN   16
-#define STRINGS_EXP_FACTOR 8
-#define STRINGS_EXPAND(x) (x / STRINGS_EXP_FACTOR + 1) * STRINGS_EXP_FACTOR
 
+/* Make room in $sl for $expand more strings (and the NULL
+   terminator).  The array at least doubles each time it has
+   to grow, so that appending N strings, one at a time, only
+   copies O(N) pointers all told. */
 static int s_strings_expand(strings_t *sl, size_t expand)
 {
-	assert(sl);         // LCOV_EXCL_LINE
-	assert(expand > 0); // LCOV_EXCL_LINE
+	assert(sl); // LCOV_EXCL_LINE
 
 	char **s;
-	expand = STRINGS_EXPAND(expand) + sl->len;
-	s = realloc(sl->strings, expand * sizeof(char *));
+	size_t want = sl->num + expand + 1, len = sl->len;
+	if (want < sl->num) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if (want <= sl->len) {
+		return 0;
+	}
+
+	if (len < STRINGS_INIT_LEN) {
+		len = STRINGS_INIT_LEN;
+	}
+	while (len < want) {
+		len = len * 2 > len ? len * 2 : want;
+	}
+
+	s = realloc(sl->strings, len * sizeof(char *));
 	if (!s) {
 		return -1;
 	}
 
 	sl->strings = s;
-	for (; sl->len < expand; sl->len++) {
+	for (; sl->len < len; sl->len++) {
 		sl->strings[sl->len] = NULL;
 	}
 
 	return 0;
 }
 
+/* Copy $s into $sl's storage. */
+static char* s_strings_copy(strings_t *sl, const char *s)
+{
+	return sl->arena ? arena_strdup(sl->arena, s) : strdup(s);
+}
+
+/* Copy the $n octets at $s into $sl's storage, NUL-terminated. */
+static char* s_strings_copyn(strings_t *sl, const char *s, size_t n)
+{
+	char *copy = sl->arena ? arena_alloc(sl->arena, n + 1) : malloc(n + 1);
+	if (!copy) {
+		return NULL;
+	}
+	memcpy(copy, s, n);
+	copy[n] = '\0';
+	return copy;
+}
+
+/* Release $s, a string from $sl (arena strings stay put). */
+static void s_strings_release(strings_t *sl, char *s)
+{
+	if (!sl->arena) {
+		free(s);
+	}
+}
+
 /* Remove NULL strings from $sl. */
 static int s_strings_reduce(strings_t *sl)
 {
@@ -301,7 +343,7 @@ strings_t* strings_new(char **src)
 		while (*t++)
 			;
 		sl->num = t - src - 1;
-		sl->len = STRINGS_EXPAND(sl->num);
+		sl->len = sl->num < STRINGS_INIT_LEN ? STRINGS_INIT_LEN : sl->num + 1;
 	} else {
 		sl->num = 0;
 		sl->len = STRINGS_INIT_LEN;
@@ -315,13 +357,55 @@ strings_t* strings_new(char **src)
 
 	if (src) {
 		for (t = sl->strings; *src; src++, t++) {
-			*t = strdup(*src);
+			*t = s_strings_copy(sl, *src);
 		}
 	}
 
 	return sl;
 }
 
+/**
+  Create a new, arena-backed String List.
+
+  Works just like @strings_new, except that the strings in the
+  list (both from $src, and added later) are packed, one after
+  the other, into a handful of large blocks of memory owned by
+  the list, instead of each being allocated separately.  That
+  makes building the list cheaper, iterating over it friendlier
+  to the CPU cache, and @strings_free a matter of a few calls to
+  `free(3)`.
+
+  The catch is that strings removed from the list (i.e. via
+  @strings_remove or @strings_uniq) aren't freed until the list
+  is, so arena-backed lists are best for lists that are built
+  up, used, and thrown away, like the results of @strings_split
+  (see `SPLIT_ARENA`).
+
+  On success, a new string list is returned.  This pointer must
+  be freed via @strings_free.  On failure, returns NULL.
+ */
+strings_t* strings_new_arena(char **src)
+{
+	strings_t *sl = strings_new(NULL);
+	if (!sl) { return NULL; }
+
+	sl->arena = arena_new(0);
+	if (!sl->arena) {
+		strings_free(sl);
+		return NULL;
+	}
+
+	if (src) {
+		for (; *src; src++) {
+			if (strings_add(sl, *src) != 0) {
+				strings_free(sl);
+				return NULL;
+			}
+		}
+	}
+	return sl;
+}
+
 /**
   Duplicate $orig.
 
@@ -338,12 +422,16 @@ strings_t* strings_new(char **src)
   strings_t *new2 = strings_new(orig->strings);
   </code>
 
+  The new list is arena-backed (see @strings_new_arena) if (and
+  only if) $orig is.
+
   On success, a new stringlist that is equivalent to $orig
   is returned.  On failure, NULL is returned.
  */
 strings_t* strings_dup(strings_t *orig)
 {
-	return strings_new(orig->strings);
+	return orig->arena ? strings_new_arena(orig->strings)
+	                   : strings_new(orig->strings);
 }
 
 /**
@@ -353,8 +441,12 @@ void strings_free(strings_t *sl)
 {
 	size_t i;
 	if (sl) {
-		for_each_string(sl,i) {
-			free(sl->strings[i]);
+		if (sl->arena) {
+			arena_free(sl->arena);
+		} else {
+			for_each_string(sl,i) {
+				free(sl->strings[i]);
+			}
 		}
 		free(sl->strings);
 	}
@@ -423,7 +515,7 @@ void strings_uniq(strings_t *sl)
 	strings_sort(sl, STRINGS_ASC);
 	for (i = 0; i < sl->num - 1; i++) {
 		if (strcmp(sl->strings[i], sl->strings[i+1]) == 0) {
-			free(sl->strings[i]);
+			s_strings_release(sl, sl->strings[i]);
 			sl->strings[i] = NULL;
 		}
 	}
@@ -450,6 +542,47 @@ int strings_search(const strings_t *sl, const char* needle)
 	return -1;
 }
 
+/**
+  Search for string view $needle in $sl.
+
+  Works just like @strings_search, except that $needle does not
+  have to be NUL-terminated (i.e. it came from @strsplit_next).
+ */
+int strings_search_view(const strings_t *sl, strview_t needle)
+{
+	assert(sl); // LCOV_EXCL_LINE
+
+	size_t i;
+	for_each_string(sl,i) {
+		if (strview_eq(needle, sl->strings[i])) {
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+  Make sure that $sl has room for (at least) $n strings.
+
+  Adding strings to a list grows it as needed, but if you know
+  up front how many strings a list will end up with, reserving
+  room for them all at once saves re-allocating (and copying)
+  the list as it grows.  Reserving less room than $sl already
+  has does nothing; lists never shrink.
+
+  On success, returns 0.  On failure, returns non-zero, and $sl
+  is unmodified.
+ */
+int strings_reserve(strings_t *sl, size_t n)
+{
+	assert(sl); // LCOV_EXCL_LINE
+
+	if (n <= sl->num) {
+		return 0;
+	}
+	return s_strings_expand(sl, n - sl->num);
+}
+
 /**
   Append a copy of $str to $sl.
 
@@ -460,12 +593,33 @@ int strings_add(strings_t *sl, const char* str)
 	assert(sl);  // LCOV_EXCL_LINE
 	assert(str); // LCOV_EXCL_LINE
 
+	return strings_add_view(sl, strview(str));
+}
+
+/**
+  Append a (NUL-terminated) copy of string view $v to $sl.
+
+  This is the cheapest way to add a token from @strsplit_next
+  to a list: the token is copied exactly once, straight from
+  the original buffer.
+
+  On success, returns 0.  On failure, returns non-zero.
+ */
+int strings_add_view(strings_t *sl, strview_t v)
+{
+	assert(sl);    // LCOV_EXCL_LINE
+	assert(v.ptr || v.len == 0); // LCOV_EXCL_LINE
+
 	/* expand as needed */
 	if (s_strings_capacity(sl) == 0 && s_strings_expand(sl, 1) != 0) {
 		return -1;
 	}
 
-	sl->strings[sl->num++] = strdup(str);
+	char *copy = s_strings_copyn(sl, v.ptr ? v.ptr : "", v.len);
+	if (!copy) {
+		return -1;
+	}
+	sl->strings[sl->num++] = copy;
 	sl->strings[sl->num] = NULL;
 
 	return 0;
@@ -492,7 +646,7 @@ int strings_add_all(strings_t *dst, const strings_t *src)
 	}
 
 	for_each_string(src,i) {
-		dst->strings[dst->num++] = strdup(src->strings[i]);
+		dst->strings[dst->num++] = s_strings_copy(dst, src->strings[i]);
 	}
 	dst->strings[dst->num] = NULL;
 
@@ -533,7 +687,7 @@ int strings_remove(strings_t *sl, const char *str)
 
 	if (removed) {
 		sl->num--;
-		free(removed);
+		s_strings_release(sl, removed);
 		return 0;
 	}
 
@@ -581,7 +735,7 @@ int strings_remove_all(strings_t *dst, strings_t *src)
 	for_each_string(dst,d) {
 		for_each_string(src,s) {
 			if ( strcmp(dst->strings[d], src->strings[s]) == 0 ) {
-				free(dst->strings[d]);
+				s_strings_release(dst, dst->strings[d]);
 				dst->strings[d] = NULL;
 				break;
 			}
@@ -719,6 +873,10 @@ char* strings_join(strings_t *list, const char *delim)
   - **SPLIT_NORMAL** - Empty tokens are ignored
   - **SPLIT_GREEDY** - Empty tokens are not ignored
 
+  `SPLIT_ARENA` can be or'd in, to get an arena-backed list (see
+  @strings_new_arena), which is much cheaper to build and free
+  when splitting lots of tokens.
+
   Examples:
 
   <code>
@@ -730,37 +888,138 @@ char* strings_join(strings_t *list, const char *delim)
  */
 strings_t* strings_split(const char *str, size_t len, const char *delim, int opt)
 {
-	strings_t *list = strings_new(NULL);
-	const char *a, *b, *end = str + len;
-	size_t delim_len = strlen(delim);
-	char *item;
+	strings_t *list = opt & SPLIT_ARENA ? strings_new_arena(NULL) : strings_new(NULL);
+	strsplit_t it;
+	strview_t tok;
 
-	a = str;
-	while (a < end) {
-		for (b = a; b < end; b++) {
-			if (strncmp(b, delim, delim_len) == 0) {
-				break;
-			}
+	if (!list) {
+		return NULL;
+	}
+
+	strsplit_init(&it, str, len, delim, opt);
+	while (strsplit_next(&it, &tok)) {
+		if (strings_add_view(list, tok) != 0) {
+			strings_free(list);
+			return NULL;
 		}
+	}
 
-		if (opt != SPLIT_GREEDY || a != b) {
-			item = calloc(b - a + 1, sizeof(char));
-			if (!item) {
-				strings_free(list);
-				return NULL;
-			}
-			memcpy(item, a, b - a);
-			item[b-a] = '\0';
+	return list;
+}
 
-			if (strings_add(list, item) != 0) {
-				strings_free(list);
-				return NULL;
+/**
+  Make a string view of the NUL-terminated string $s.
+
+  The view points into $s; nothing is copied or allocated, so
+  it is only good for as long as $s is.
+ */
+strview_t strview(const char *s)
+{
+	strview_t v = { s, s ? strlen(s) : 0 };
+	return v;
+}
+
+/**
+  Check if string view $v holds the same octets as the
+  NUL-terminated string $s.
+
+  Returns non-zero if they are equal, and 0 if they are not.
+ */
+int strview_eq(strview_t v, const char *s)
+{
+	assert(s); // LCOV_EXCL_LINE
+	return strnlen(s, v.len + 1) == v.len && (!v.len || memcmp(s, v.ptr, v.len) == 0);
+}
+
+/**
+  Copy string view $v into a new, NUL-terminated string.
+
+  On success, returns the new string, which must be freed by
+  the caller.  On failure, returns NULL.
+ */
+char* strview_dup(strview_t v)
+{
+	char *s = malloc(v.len + 1);
+	if (!s) {
+		return NULL;
+	}
+	if (v.len) {
+		memcpy(s, v.ptr, v.len);
+	}
+	s[v.len] = '\0';
+	return s;
+}
+
+/**
+  Start splitting the first $len octets of $str on $delim.
+
+  This is the allocation-free counterpart to @strings_split:
+  instead of building a list of copies, $it hands out tokens
+  one at a time, via @strsplit_next, as views into $str.  $str
+  does not need to be NUL-terminated, but it (and $delim) must
+  outlive $it.
+
+  $opt is either `SPLIT_NORMAL` or `SPLIT_GREEDY`, and treats
+  empty tokens just like @strings_split does.
+
+  Examples:
+
+  <code>
+  strsplit_t it;
+  strview_t tok;
+
+  strsplit_init(&it, line, strlen(line), ",", SPLIT_NORMAL);
+  while (strsplit_next(&it, &tok)) {
+    printf("field: %.*s\n", (int)tok.len, tok.ptr);
+  }
+  </code>
+ */
+void strsplit_init(strsplit_t *it, const char *str, size_t len, const char *delim, int opt)
+{
+	assert(it);    // LCOV_EXCL_LINE
+	assert(str);   // LCOV_EXCL_LINE
+	assert(delim); // LCOV_EXCL_LINE
+
+	it->next      = str;
+	it->end       = str + len;
+	it->delim     = delim;
+	it->delim_len = strlen(delim);
+	it->opt       = opt;
+}
+
+/**
+  Fetch the next token from splitter $it into $tok.
+
+  Returns 1 if a token was found, and 0 once $it has run out of
+  tokens (in which case $tok is left alone).  If the delimiter
+  is the empty string, the whole string is a single token.
+ */
+int strsplit_next(strsplit_t *it, strview_t *tok)
+{
+	assert(it);  // LCOV_EXCL_LINE
+	assert(tok); // LCOV_EXCL_LINE
+
+	const char *a, *b;
+	while (it->next < it->end) {
+		a = it->next;
+		if (it->delim_len == 0) {
+			b = it->end;
+		} else {
+			for (b = a; b < it->end; b++) {
+				if ((size_t)(it->end - b) >= it->delim_len
+				 && *b == *it->delim
+				 && memcmp(b, it->delim, it->delim_len) == 0) {
+					break;
+				}
 			}
+		}
+		it->next = b == it->end ? b : b + it->delim_len;
 
-			free(item);
+		if (!(it->opt & SPLIT_GREEDY) || a != b) {
+			tok->ptr = a;
+			tok->len = b - a;
+			return 1;
 		}
-		a = b + delim_len;
 	}
-
-	return list;
+	return 0;
 }
@@ -25,6 +25,73 @@ void destroyer(void *d)
 	global_counter++;
 }
 
+static int LOADS = 0;
+static void* slow_loader(const char *id, void *ctx)
+{
+	__sync_fetch_and_add(&LOADS, 1);
+	sleep_ms(100);
+	if (strcmp(id, "fail") == 0) {
+		errno = ENOENT;
+		return NULL;
+	}
+	return ctx;
+}
+
+struct loader_thread {
+	pthread_t   tid;
+	cache_t    *cc;
+	const char *id;
+	void       *got;
+	int         error;
+};
+
+static void* load_it(void *arg)
+{
+	struct loader_thread *t = arg;
+	errno = 0;
+	t->got   = cache_get_or_load(t->cc, t->id, slow_loader, (void *)42);
+	t->error = errno;
+	return NULL;
+}
+
+struct ccache_thread {
+	pthread_t  tid;
+	ccache_t  *cc;
+	int        n;
+	size_t     hits;
+};
+
+static void* hammer_it(void *arg)
+{
+	struct ccache_thread *t = arg;
+	char key[32];
+	int i;
+
+	for (i = 0; i < 2000; i++) {
+		snprintf(key, sizeof(key), "key%d", (i * 31 + t->n * 7) % 500);
+		if (ccache_get(t->cc, key)) t->hits++;
+		else ccache_set(t->cc, key, (void *)1);
+	}
+	return NULL;
+}
+
+static ssize_t pack_string(const void *data, void *buf, size_t len)
+{
+	size_t n = strlen(data);
+	if (strcmp(data, "secret") == 0)
+		return -1;
+	if (n <= len)
+		memcpy(buf, data, n);
+	return n;
+}
+
+static void* unpack_string(const void *buf, size_t len)
+{
+	char *s = calloc(len + 1, 1);
+	memcpy(s, buf, len);
+	return s;
+}
+
 TESTS {
 	alarm(5);
 	subtest { /* basic types */
@@ -122,6 +189,63 @@ TESTS {
 		cache_free(cc);
 	}
 
+	subtest { /* resizing caches in place */
+		cache_t *cc = cache_new(4, 20), *was = cc;
+		int lru = VIGOR_CACHE_EVICT_LRU;
+		cache_entry_t *ent;
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, destroyer), 0, "set destructor");
+		is_int(cache_setopt(cc, VIGOR_CACHE_EVICTION, &lru), 0, "set LRU eviction");
+		cache_set(cc, "key1", (void*)1);
+		cache_set(cc, "key2", (void*)2);
+		cache_set(cc, "key3", (void*)3);
+		cache_set(cc, "key4", (void*)4);
+		ent = hash_get(&cc->index, "key2");
+
+		ok(cache_resize(&cc, 6) == 0, "resized cache from 4 to 6 entries");
+		ok(cc == was, "cache was resized in place");
+		ok(hash_get(&cc->index, "key2") == ent, "entries did not move");
+		is_int(cc->len, 4, "4 entries still in the cache");
+		is_ptr(cache_get(cc, "key1"), (void*)1, "key1 survived the resize");
+
+		isnt_null(cache_set(cc, "key5", (void*)5), "key5 inserted (without eviction)");
+		isnt_null(cache_set(cc, "key6", (void*)6), "key6 inserted (without eviction)");
+		ok(cache_isfull(cc), "cache is full");
+		isnt_null(cache_set(cc, "key7", (void*)7), "key7 inserted");
+		is_null(cache_get(cc, "key2"), "key2 evicted (least recently used, from before the resize)");
+		is_ptr(cache_get(cc, "key1"), (void*)1, "key1 still in cache");
+
+		global_counter = 0;
+		cache_free(cc);
+		is_int(global_counter, 6, "all 6 live entries destroyed by cache_free()");
+	}
+
+	subtest { /* resizing S3-FIFO caches */
+		cache_t *cc = cache_new(10, 20);
+		int s3fifo = VIGOR_CACHE_EVICT_S3FIFO;
+		char key[32];
+		size_t i;
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_EVICTION, &s3fifo), 0, "set S3-FIFO eviction");
+		for (i = 0; i < 25; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			cache_set(cc, key, (void*)1);
+		}
+		is_int(cc->ghost.len, 10, "ghost queue has wrapped");
+
+		ok(cache_resize(&cc, 20) == 0, "resized cache from 10 to 20 entries");
+		is_int(cc->ghost.len, 10, "ghost queue kept its entries");
+		for (i = 0; i < 100; i++) {
+			snprintf(key, sizeof(key), "more%lu", i);
+			cache_set(cc, key, (void*)1);
+		}
+		is_int(cc->ghost.len, 20, "ghost queue grew with the cache");
+		is_int(ihash_len(&cc->ghost.index) <= 20, 1, "ghost index is bounded by the new size");
+		is_int(cc->len, 20, "cache is full, at its new size");
+
+		cache_free(cc);
+	}
+
 	subtest { /* too much! */
 		cache_t *cc = cache_new(4, 20);
 
@@ -178,6 +302,585 @@ TESTS {
 		cache_free(cc);
 	}
 
+	subtest { /* free list */
+		cache_t *cc = cache_new(4000, 20);
+		char key[32];
+		size_t i, bad = 0;
+
+		for (i = 0; i < 4000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			if (!cache_set(cc, key, (void *)(i + 1))) bad++;
+		}
+		is_int(bad, 0, "filled a 4k-entry cache");
+		is_int(cc->len, 4000, "cache has 4k live entries");
+		ok(cache_isfull(cc), "cache is full");
+		is_null(cache_set(cc, "one-more", (void *)1), "can't insert into a full cache");
+
+		for (i = 0; i < 4000; i += 2) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			cache_unset(cc, key);
+		}
+		is_int(cc->len, 2000, "unset half of the entries");
+		ok(!cache_isfull(cc), "cache is no longer full");
+
+		for (i = 0; i < 2000; i++) {
+			snprintf(key, sizeof(key), "new%lu", i);
+			if (!cache_set(cc, key, (void *)(i + 1))) bad++;
+		}
+		is_int(bad, 0, "re-used every freed entry");
+		ok(cache_isfull(cc), "cache is full again");
+
+		for (i = 1; i < 4000; i += 2) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			if (cache_get(cc, key) != (void *)(i + 1)) bad++;
+		}
+		is_int(bad, 0, "original entries are intact");
+
+		cache_purge(cc, 1);
+		ok(cache_isempty(cc), "forced purge empties the cache");
+		is_int(cc->len, 0, "no live entries left");
+
+		cache_free(cc);
+	}
+
+	subtest { /* LRU eviction */
+		cache_t *cc = cache_new(3, 20);
+		int lru = VIGOR_CACHE_EVICT_LRU, bogus = 42;
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, destroyer), 0, "set destructor");
+		is_int(cache_setopt(cc, VIGOR_CACHE_EVICTION, &bogus), 1, "unknown eviction policy");
+		is_int(cache_setopt(cc, VIGOR_CACHE_EVICTION, &lru), 0, "set LRU eviction");
+
+		global_counter = 0;
+		isnt_null(cache_set(cc, "key1", (void*)1), "key1 inserted");
+		isnt_null(cache_set(cc, "key2", (void*)2), "key2 inserted");
+		isnt_null(cache_set(cc, "key3", (void*)3), "key3 inserted");
+		ok(cache_isfull(cc), "cache is full");
+
+		isnt_null(cache_get(cc, "key1"), "key1 used (key2 is now least recent)");
+		isnt_null(cache_set(cc, "key4", (void*)4), "key4 inserted into a full cache");
+		is_int(global_counter, 1, "evicted entry was destroyed");
+		is_null(cache_get(cc, "key2"), "key2 was evicted");
+		isnt_null(cache_get(cc, "key1"), "key1 survived");
+		isnt_null(cache_get(cc, "key3"), "key3 survived");
+
+		isnt_null(cache_set(cc, "key1", (void*)1), "key1 updated (key4 is now least recent)");
+		isnt_null(cache_set(cc, "key5", (void*)5), "key5 inserted");
+		is_null(cache_get(cc, "key4"), "key4 was evicted");
+		is_int(cc->len, 3, "cache still has 3 entries");
+
+		cache_free(cc);
+	}
+
+	subtest { /* S3-FIFO eviction */
+		cache_t *lru = cache_new(100, 20);
+		cache_t *s3  = cache_new(100, 20);
+		int policy;
+		char key[32];
+		size_t i, r, hot_lru = 0, hot_s3 = 0;
+
+		policy = VIGOR_CACHE_EVICT_LRU;
+		is_int(cache_setopt(lru, VIGOR_CACHE_EVICTION, &policy), 0, "set LRU eviction");
+		policy = VIGOR_CACHE_EVICT_S3FIFO;
+		is_int(cache_setopt(s3, VIGOR_CACHE_EVICTION, &policy), 0, "set S3-FIFO eviction");
+
+		/* a hot set of 20 keys, used over and over */
+		for (r = 0; r < 5; r++) {
+			for (i = 0; i < 20; i++) {
+				snprintf(key, sizeof(key), "hot%lu", i);
+				if (!cache_get(lru, key)) cache_set(lru, key, (void *)1);
+				if (!cache_get(s3,  key)) cache_set(s3,  key, (void *)1);
+			}
+		}
+
+		/* ... and then a sweep over 1000 keys, used once each */
+		for (r = i = 0; i < 1000; i++) {
+			snprintf(key, sizeof(key), "cold%lu", i);
+			if (!cache_get(lru, key) && !cache_set(lru, key, (void *)2)) r++;
+			if (!cache_get(s3,  key) && !cache_set(s3,  key, (void *)2)) r++;
+		}
+		is_int(r, 0, "every cold key was cached (by evicting something)");
+		ok(cache_isfull(lru), "LRU cache is full");
+		ok(cache_isfull(s3),  "S3-FIFO cache is full");
+
+		for (i = 0; i < 20; i++) {
+			snprintf(key, sizeof(key), "hot%lu", i);
+			if (cache_get(lru, key)) hot_lru++;
+			if (cache_get(s3,  key)) hot_s3++;
+		}
+		is_int(hot_lru, 0,  "the sweep flushed the hot set out of the LRU cache");
+		is_int(hot_s3,  20, "the hot set survived the sweep in the S3-FIFO cache");
+
+		snprintf(key, sizeof(key), "cold%lu", 999UL);
+		isnt_null(cache_get(s3, key), "the most recent cold key is still cached");
+		snprintf(key, sizeof(key), "cold%lu", 0UL);
+		isnt_null(cache_set(s3, key, (void *)3), "re-set a ghosted key");
+
+		policy = VIGOR_CACHE_EVICT_NONE;
+		is_int(cache_setopt(s3, VIGOR_CACHE_EVICTION, &policy), 0, "turn off eviction");
+		is_int(s3->nsmall, 0, "small queue emptied into the main queue");
+		is_null(cache_set(s3, "one-more", (void *)4), "full cache rejects new keys");
+
+		cache_free(lru);
+		cache_free(s3);
+	}
+
+	subtest { /* timer wheel */
+		cache_t *cc = cache_new(1000, 1);
+		char key[32];
+		size_t i, n;
+		int32_t now = time_s();
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, destroyer), 0, "set destructor");
+		for (i = 0; i < 1000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			cache_set(cc, key, (void *)1);
+		}
+		/* spread the entries out, over a few revolutions of the wheel */
+		for (i = 0; i < 1000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			cache_touch(cc, key, i % 2 ? now + (int32_t)i : now - (int32_t)i - 2);
+		}
+
+		global_counter = 0;
+		cache_purge(cc, 0);
+		is_int(global_counter, 500, "purged the 500 entries touched into the past");
+		is_int(cc->len, 500, "500 entries left");
+
+		for (n = 0, i = 1; i < 1000; i += 2) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			if (cache_get(cc, key)) n++;
+		}
+		is_int(n, 500, "entries that expire later are all still there");
+
+		int life = -1000;
+		is_int(cache_setopt(cc, VIGOR_CACHE_EXPIRY, &life), 0, "shortened the expiry");
+		cache_purge(cc, 0);
+		is_int(global_counter, 1000, "everything has now expired");
+		ok(cache_isempty(cc), "cache is empty");
+
+		cache_free(cc);
+	}
+
+	subtest { /* per-entry TTLs */
+		cache_t *cc = cache_new(8, 3600);
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, destroyer), 0, "set destructor");
+
+		isnt_null(cache_set_ttl(cc, "gone", (void*)1, -1),  "set 'gone' (already expired)");
+		isnt_null(cache_set_ttl(cc, "ttl",  (void*)2, 300), "set 'ttl' for 300s");
+		isnt_null(cache_set(cc,     "set",  (void*)3),      "set 'set' for the default 3600s");
+		is_int(cc->len, 3, "3 entries in the cache");
+
+		global_counter = 0;
+		is_null(cache_get(cc, "gone"), "expired entry is a miss, even before a purge");
+		is_int(global_counter, 1, "expired entry was destroyed on lookup");
+		is_int(cc->len, 2, "expired entry was reclaimed on lookup");
+		is_ptr(cache_get(cc, "ttl"), (void*)2, "'ttl' is still live");
+
+		int life = -1000;
+		is_int(cache_setopt(cc, VIGOR_CACHE_EXPIRY, &life), 0, "shortened the default expiry");
+		cache_purge(cc, 0);
+		is_int(global_counter, 2, "purge expired the entry without a TTL");
+		is_ptr(cache_get(cc, "ttl"), (void*)2, "'ttl' ignores the default expiry");
+
+		isnt_null(cache_set_ttl(cc, "ttl", (void*)2, -1), "shortened the TTL of 'ttl'");
+		is_null(cache_get(cc, "ttl"), "'ttl' is gone");
+		ok(cache_isempty(cc), "cache is empty");
+
+		life = 3600;
+		is_int(cache_setopt(cc, VIGOR_CACHE_EXPIRY, &life), 0, "restored the default expiry");
+		isnt_null(cache_set_ttl(cc, "key", (void*)4, -1), "set 'key' (already expired)");
+		isnt_null(cache_set(cc, "key", (void*)4), "re-set 'key' without a TTL");
+		is_ptr(cache_get(cc, "key"), (void*)4, "plain cache_set cleared the TTL");
+
+		isnt_null(cache_set_ttl(cc, "key", (void*)4, -1), "set 'key' (already expired) again");
+		cache_touch(cc, "key", 0);
+		is_ptr(cache_get(cc, "key"), (void*)4, "cache_touch cleared the TTL");
+
+		cache_free(cc);
+	}
+
+	subtest { /* expired entries are reclaimed on insert */
+		cache_t *cc = cache_new(4, 3600);
+		char key[32];
+		size_t i;
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, destroyer), 0, "set destructor");
+		for (i = 0; i < 4; i++) {
+			snprintf(key, sizeof(key), "old%lu", i);
+			cache_set_ttl(cc, key, (void *)1, -1);
+		}
+		ok(cache_isfull(cc), "cache is full of expired entries");
+
+		global_counter = 0;
+		for (i = 0; i < 4; i++) {
+			snprintf(key, sizeof(key), "new%lu", i);
+			isnt_null(cache_set(cc, key, (void *)2), "set new entry without a purge");
+		}
+		is_int(global_counter, 4, "expired entries were destroyed to make room");
+		ok(cache_isfull(cc), "cache is full again");
+		is_null(cache_set(cc, "another", (void *)3), "no room left (nothing has expired)");
+
+		cache_free(cc);
+	}
+
+	subtest { /* cost budget */
+		cache_t *cc = cache_new(100, 3600);
+		size_t budget = 1000;
+		int lru = VIGOR_CACHE_EVICT_LRU;
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, destroyer), 0, "set destructor");
+		is_int(cache_setopt(cc, VIGOR_CACHE_BUDGET, &budget), 0, "set a budget of 1000");
+
+		global_counter = 0;
+		isnt_null(cache_set_cost(cc, "a", (void*)1, 400), "set 'a' (400)");
+		isnt_null(cache_set_cost(cc, "b", (void*)2, 400), "set 'b' (400)");
+		is_int(cc->cost, 800, "cache costs 800");
+		errno = 0;
+		is_null(cache_set_cost(cc, "c", (void*)3, 400), "no room for 'c', without an eviction policy");
+		is_int(errno, ENOSPC, "cache_set_cost() sets errno to ENOSPC");
+
+		errno = 0;
+		is_null(cache_set_cost(cc, "a", (void*)6, 700), "no room to grow 'a', without an eviction policy");
+		is_int(errno, ENOSPC, "cache_set_cost() sets errno to ENOSPC");
+		is_int(global_counter, 0, "old value of 'a' was not destroyed");
+		is_ptr(cache_get(cc, "a"), (void*)1, "'a' keeps its old value");
+		is_int(cc->cost, 800, "cache still costs 800");
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_EVICTION, &lru), 0, "set LRU eviction");
+		isnt_null(cache_set_cost(cc, "c", (void*)3, 400), "set 'c' (400)");
+		is_int(global_counter, 1, "one entry evicted to make room");
+		is_null(cache_get(cc, "a"), "'a' was evicted");
+		is_int(cc->cost, 800, "cache costs 800");
+
+		errno = 0;
+		is_null(cache_set_cost(cc, "huge", (void*)4, 1001), "'huge' can never fit");
+		is_int(errno, ENOSPC, "cache_set_cost() sets errno to ENOSPC");
+		is_int(cc->len, 2, "nothing was evicted for it");
+
+		isnt_null(cache_set_cost(cc, "b", (void*)2, 600), "grow 'b' to 600 (fits)");
+		is_int(cc->cost, 1000, "cache costs 1000");
+		isnt_null(cache_set_cost(cc, "c", (void*)3, 500), "grow 'c' to 500 (doesn't fit)");
+		is_int(cc->len, 1, "'b' was evicted to make room");
+		is_ptr(cache_get(cc, "c"), (void*)3, "'c' is still in the cache");
+		is_int(cc->cost, 500, "cache costs 500");
+
+		isnt_null(cache_set(cc, "free", (void*)5), "entries set with cache_set() cost nothing");
+		is_int(cc->cost, 500, "cache still costs 500");
+
+		budget = 100;
+		is_int(cache_setopt(cc, VIGOR_CACHE_BUDGET, &budget), 0, "shrink the budget to 100");
+		ok(cc->cost <= 100, "cache was evicted down to its new budget");
+		is_null(cache_get(cc, "c"), "'c' was evicted");
+
+		cache_unset(cc, "free");
+		is_int(cc->cost, 0, "empty cache costs nothing");
+		cache_free(cc);
+	}
+
+	subtest { /* cost budget with S3-FIFO */
+		cache_t *cc = cache_new(1000, 3600);
+		size_t budget = 10000, i, over = 0, cost;
+		int s3fifo = VIGOR_CACHE_EVICT_S3FIFO;
+		char key[32];
+		cache_entry_t *ent;
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_EVICTION, &s3fifo), 0, "set S3-FIFO eviction");
+		is_int(cache_setopt(cc, VIGOR_CACHE_BUDGET, &budget), 0, "set a budget of 10000");
+		for (i = 0; i < 5000; i++) {
+			snprintf(key, sizeof(key), "key%lu", (i * 7) % 300);
+			if (!cache_get(cc, key))
+				cache_set_cost(cc, key, (void *)1, 10 + (i * 13) % 500);
+			if (cc->cost > budget) over++;
+		}
+		is_int(over, 0, "cache never went over budget");
+
+		cost = 0;
+		for_each_object(ent, &cc->small, l)
+			cost += ent->cost;
+		is_int(cc->csmall, cost, "small queue cost is the sum of its entries' costs");
+
+		for_each_object(ent, &cc->live, l)
+			cost += ent->cost;
+		is_int(cc->cost, cost, "cache cost is the sum of its entries' costs");
+
+		cache_free(cc);
+	}
+
+	subtest { /* read-through loading */
+		cache_t *cc = cache_new(10, 3600);
+		struct loader_thread t[8];
+		size_t i, n;
+
+		LOADS = 0;
+		is_ptr(cache_get_or_load(cc, "key", slow_loader, (void *)42), (void *)42,
+			"cache_get_or_load() loads a missing key");
+		is_int(LOADS, 1, "loader was called once");
+		is_ptr(cache_get(cc, "key"), (void *)42, "loaded object was cached");
+		is_ptr(cache_get_or_load(cc, "key", slow_loader, (void *)43), (void *)42,
+			"cache_get_or_load() returns a cached key");
+		is_int(LOADS, 1, "loader was not called for a hit");
+
+		LOADS = 0;
+		for (i = 0; i < 8; i++) {
+			t[i].cc = cc;
+			t[i].id = "shared";
+			pthread_create(&t[i].tid, NULL, load_it, &t[i]);
+		}
+		for (n = 0, i = 0; i < 8; i++) {
+			pthread_join(t[i].tid, NULL);
+			if (t[i].got == (void *)42) n++;
+		}
+		is_int(LOADS, 1, "8 concurrent misses only called the loader once");
+		is_int(n, 8, "all 8 callers got the loaded object");
+
+		LOADS = 0;
+		for (i = 0; i < 8; i++) {
+			t[i].cc = cc;
+			t[i].id = "fail";
+			pthread_create(&t[i].tid, NULL, load_it, &t[i]);
+		}
+		for (n = 0, i = 0; i < 8; i++) {
+			pthread_join(t[i].tid, NULL);
+			if (!t[i].got && t[i].error == ENOENT) n++;
+		}
+		is_int(LOADS, 1, "8 concurrent failed loads only called the loader once");
+		is_int(n, 8, "all 8 callers got the failure (and errno)");
+		is_null(cache_get(cc, "fail"), "failures are not cached");
+
+		LOADS = 0;
+		is_null(cache_get_or_load(cc, "fail", slow_loader, NULL), "failed load fails again");
+		is_int(LOADS, 1, "loader was called again, after a failure");
+		is_int(hash_len(&cc->loading), 0, "no loads left in flight");
+
+		cache_free(cc);
+	}
+
+	subtest { /* sharded caches */
+		ccache_t *cc = ccache_new(100, 3600, 3);
+		size_t i;
+
+		is_int(cc->n, 4, "shard count rounds up to a power of two");
+		for (i = 0; i < cc->n; i++)
+			if (cc->shards[i].cache->max_len != 25) break;
+		is_int(i, 4, "entries are split evenly across shards");
+
+		is_null(ccache_get(cc, "key"), "empty cache has no 'key'");
+		is_ptr(ccache_set(cc, "key", (void *)1), (void *)1, "set 'key'");
+		is_ptr(ccache_get(cc, "key"), (void *)1, "retrieved 'key'");
+		is_int(ccache_len(cc), 1, "1 entry in the cache");
+		isnt_null(ccache_set_ttl(cc, "gone", (void *)2, -1), "set 'gone' (already expired)");
+		is_null(ccache_get(cc, "gone"), "expired entry is a miss");
+		is_ptr(ccache_unset(cc, "key"), (void *)1, "unset 'key'");
+		is_null(ccache_get(cc, "key"), "'key' is gone");
+
+		ccache_purge(cc, 0);
+		is_int(ccache_len(cc), 0, "purge reclaimed the expired entry");
+		ccache_free(cc);
+	}
+
+	subtest { /* sharded caches: access bits */
+		ccache_t *cc = ccache_new(3, 3600, 1);
+		int lru = VIGOR_CACHE_EVICT_LRU;
+		is_int(ccache_setopt(cc, VIGOR_CACHE_EVICTION, &lru), 0, "set LRU eviction");
+
+		ccache_set(cc, "a", (void *)1);
+		ccache_set(cc, "b", (void *)2);
+		ccache_set(cc, "c", (void *)3);
+		isnt_null(ccache_get(cc, "a"), "hit 'a'");
+		isnt_null(ccache_set(cc, "d", (void *)4), "set 'd' in a full cache");
+		isnt_null(ccache_get(cc, "a"), "'a' was hit, and kept");
+		is_null(ccache_get(cc, "b"), "'b' was evicted instead");
+		ccache_free(cc);
+	}
+
+	subtest { /* sharded caches: threads */
+		ccache_t *cc = ccache_new(256, 3600, 8);
+		int s3fifo = VIGOR_CACHE_EVICT_S3FIFO;
+		struct ccache_thread t[8];
+		size_t i, hits = 0;
+
+		is_int(ccache_setopt(cc, VIGOR_CACHE_EVICTION, &s3fifo), 0, "set S3-FIFO eviction");
+		for (i = 0; i < 8; i++) {
+			t[i].cc   = cc;
+			t[i].n    = i;
+			t[i].hits = 0;
+			pthread_create(&t[i].tid, NULL, hammer_it, &t[i]);
+		}
+		for (i = 0; i < 8; i++) {
+			pthread_join(t[i].tid, NULL);
+			hits += t[i].hits;
+		}
+		ok(hits > 0, "threads got cache hits");
+		ok(ccache_len(cc) <= 256, "cache never outgrew its shards");
+		ccache_free(cc);
+	}
+
+	subtest { /* snapshots */
+		cache_t *cc = cache_new(5, 3600);
+		int lru = VIGOR_CACHE_EVICT_LRU;
+		FILE *io = tmpfile();
+		int fd = fileno(io);
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, free), 0, "set destructor");
+		is_int(cache_setopt(cc, VIGOR_CACHE_EVICTION, &lru), 0, "set LRU eviction");
+		cache_set(cc, "oldest", strdup("the oldest entry"));
+		cache_set_cost(cc, "middle", strdup("the middle entry, which is a bit longer than the others"), 42);
+		cache_set_ttl(cc, "newest", strdup("the newest entry"), 600);
+		cache_set_ttl(cc, "gone", strdup("an expired entry"), -1);
+
+		cache_set(cc, "secret", strdup("secret"));
+
+		is_int(cache_save(cc, fd, pack_string), 3, "saved 3 (live, packable) entries");
+		cache_free(cc);
+
+		cc = cache_new(3, 3600);
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, free), 0, "set destructor");
+		is_int(cache_setopt(cc, VIGOR_CACHE_EVICTION, &lru), 0, "set LRU eviction");
+		is_int(cache_load(cc, fd, unpack_string), 3, "loaded 3 entries");
+		is_string(cache_get(cc, "oldest"), "the oldest entry", "loaded 'oldest'");
+		is_string(cache_get(cc, "middle"), "the middle entry, which is a bit longer than the others", "loaded 'middle'");
+		is_int(cc->cost, 42, "entry costs were saved");
+		is_null(cache_get(cc, "gone"), "expired entries were not saved");
+		ok(((cache_entry_t *)hash_get(&cc->index, "newest"))->expires > 0, "TTLs were saved");
+		cache_free(cc);
+
+		cc = cache_new(3, 3600);
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, free), 0, "set destructor");
+		is_int(cache_setopt(cc, VIGOR_CACHE_EVICTION, &lru), 0, "set LRU eviction");
+		is_int(cache_load(cc, fd, unpack_string), 3, "loaded 3 entries (again)");
+		isnt_null(cache_set(cc, "another", strdup("another entry")), "set a new key in the (full) cache");
+		is_null(cache_get(cc, "oldest"), "the oldest entry (at save time) was evicted");
+		cache_free(cc);
+
+		/* cut the snapshot short */
+		struct stat st;
+		fstat(fd, &st);
+		is_int(ftruncate(fd, st.st_size - 8), 0, "truncated the snapshot");
+		cc = cache_new(3, 3600);
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, free), 0, "set destructor");
+		errno = 0;
+		is_int(cache_load(cc, fd, unpack_string), -1, "cache_load() fails on a truncated snapshot");
+		is_int(errno, EINVAL, "cache_load() sets errno to EINVAL");
+		is_int(cc->len, 2, "entries before the truncation were loaded");
+		cache_free(cc);
+
+		is_int(ftruncate(fd, 0), 0, "emptied the snapshot");
+		cc = cache_new(3, 3600);
+		is_int(cache_load(cc, fd, unpack_string), -1, "cache_load() fails on an empty file");
+		cache_free(cc);
+		fclose(io);
+	}
+
+	subtest { /* statistics */
+		cache_t *cc = cache_new(3, 3600);
+		cache_stats_t st;
+		size_t budget = 100;
+		int lru = VIGOR_CACHE_EVICT_LRU;
+
+		cache_stats(cc, &st);
+		is_int(st.hits + st.misses + st.inserts, 0, "new cache has no hits, misses or inserts");
+		is_int(st.max_len, 3, "stats report max_len");
+
+		cache_set(cc, "a", (void*)1);
+		cache_set(cc, "b", (void*)2);
+		cache_set(cc, "a", (void*)3);
+		cache_set_ttl(cc, "c", (void*)4, -1);
+		cache_get(cc, "a");
+		cache_get(cc, "b");
+		cache_get(cc, "nope");
+		cache_get(cc, "c");
+		cache_set(cc, "c", (void*)5);
+		cache_set(cc, "d", (void*)6);
+
+		cache_stats(cc, &st);
+		is_int(st.hits,        2, "2 hits");
+		is_int(st.misses,      2, "2 misses (one of them expired)");
+		is_int(st.inserts,     4, "4 inserts (updates don't count)");
+		is_int(st.expirations, 1, "1 expiration");
+		is_int(st.evictions,   0, "no evictions");
+		is_int(st.rejected,    1, "1 rejected set (no room)");
+		is_int(st.len,         3, "3 entries in the cache");
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_EVICTION, &lru), 0, "set LRU eviction");
+		is_int(cache_setopt(cc, VIGOR_CACHE_BUDGET, &budget), 0, "set a budget");
+		cache_set(cc, "d", (void*)6);
+		cache_set_cost(cc, "huge", (void*)7, 1000);
+
+		cache_stats(cc, &st);
+		is_int(st.evictions, 1, "1 eviction");
+		is_int(st.rejected,  2, "2 rejected sets (no room, too costly)");
+		is_int(st.max_cost, 100, "stats report max_cost");
+		cache_free(cc);
+	}
+
+	subtest { /* sharded statistics */
+		ccache_t *cc = ccache_new(16, 3600, 4);
+		cache_stats_t st;
+
+		ccache_set(cc, "a", (void*)1);
+		ccache_set(cc, "b", (void*)2);
+		ccache_get(cc, "a");
+		ccache_get(cc, "b");
+		ccache_get(cc, "c");
+
+		ccache_stats(cc, &st);
+		is_int(st.hits,    2, "2 hits, across shards");
+		is_int(st.misses,  1, "1 miss");
+		is_int(st.inserts, 2, "2 inserts");
+		is_int(st.len,     2, "2 entries");
+		is_int(st.max_len, 16, "16 entries, all told");
+		ccache_free(cc);
+	}
+
+	subtest { /* negative entries */
+		cache_t *cc = cache_new(4, 3600);
+		int life = 60;
+		cache_stats_t st;
+
+		is_int(cache_setopt(cc, VIGOR_CACHE_DESTRUCTOR, destroyer), 0, "set destructor");
+		is_int(cache_setopt(cc, VIGOR_CACHE_ABSENT_EXPIRY, &life), 0, "set negative entry expiry");
+		is_int(cache_set_absent(cc, "nope"), 0, "set a negative entry for 'nope'");
+		is_ptr(cache_get(cc, "nope"), VIGOR_CACHE_ABSENT, "'nope' is known not to exist");
+		is_null(cache_get(cc, "other"), "'other' is just not cached");
+		ok(((cache_entry_t *)hash_get(&cc->index, "nope"))->expires <= time_s() + 61,
+			"negative entries get their own expiry");
+
+		cache_stats(cc, &st);
+		is_int(st.hits, 1, "negative lookups count as hits");
+
+		global_counter = 0;
+		isnt_null(cache_set(cc, "nope", (void*)1), "replaced the negative entry");
+		is_ptr(cache_get(cc, "nope"), (void*)1, "'nope' exists now");
+		is_int(global_counter, 0, "negative entries aren't destroyed");
+		is_int(((cache_entry_t *)hash_get(&cc->index, "nope"))->expires, 0,
+			"replaced entry uses the global expiry");
+
+		life = -1;
+		is_int(cache_setopt(cc, VIGOR_CACHE_ABSENT_EXPIRY, &life), 0, "negative entries expire immediately");
+		is_int(cache_set_absent(cc, "gone"), 0, "set a negative entry for 'gone'");
+		is_null(cache_get(cc, "gone"), "negative entry for 'gone' has expired");
+		is_int(cache_set_absent(cc, "unset"), 0, "set a negative entry for 'unset'");
+		is_null(cache_unset(cc, "unset"), "cache_unset() returns NULL for negative entries");
+
+		life = 60;
+		is_int(cache_setopt(cc, VIGOR_CACHE_ABSENT_EXPIRY, &life), 0, "restored negative entry expiry");
+		is_int(cache_set_absent(cc, "a"), 0, "set a negative entry for 'a'");
+		is_ptr(cache_unset(cc, "nope"), (void*)1, "unset 'nope'");
+		cache_purge(cc, 1);
+		is_int(global_counter, 0, "purge doesn't destroy negative entries");
+		ok(cache_isempty(cc), "cache is empty");
+
+		cache_free(cc);
+	}
+
+	subtest { /* sharded negative entries */
+		ccache_t *cc = ccache_new(16, 3600, 4);
+		is_int(ccache_set_absent(cc, "nope"), 0, "set a negative entry for 'nope'");
+		is_ptr(ccache_get(cc, "nope"), VIGOR_CACHE_ABSENT, "'nope' is known not to exist");
+		ccache_free(cc);
+	}
+
 	alarm(0);
 	done_testing();
 }
@@ -111,6 +111,42 @@ TESTS {
 		config_done(&c);
 	}
 
+	subtest { /* interned keys */
+		CONFIG(a);
+		CONFIG(b);
+		intern_t *pool = intern_new();
+		keyval_t *x, *y;
+
+		config_set_interned(&a, "listen", "*:2323", pool);
+		config_set_interned(&b, "listen", "*:4242", pool);
+
+		FILE *io = tmpfile();
+		fprintf(io, "timeout 30\n");
+		rewind(io);
+		is_int(config_read_interned(&a, io, pool), 0, "read from tmpfile");
+		fclose(io);
+
+		x = list_head(&a, keyval_t, l);
+		y = list_head(&b, keyval_t, l);
+		is_string(x->key, "timeout", "config_read() key");
+		ok(x->key == intern_find(pool, "timeout"), "config_read() interns keys");
+		x = list_tail(&a, keyval_t, l);
+		ok(x->key == y->key, "configs share interned keys");
+		ok(x->key == intern_find(pool, "listen"), "config_set() interns keys");
+
+		is_string(config_get(&a, "listen"), "*:2323", "config[listen] via strcmp()");
+		is_string(config_get(&b, intern(pool, "listen")), "*:4242", "config[listen] via canonical key");
+
+		config_unset(&a, "timeout");
+		ok(!config_isset(&a, "timeout"), "interned key unset");
+		config_set(&a, "extra", "yes");
+		is_int(intern_len(pool), 2, "plain config_set() doesn't intern");
+		config_done(&a);
+		config_done(&b);
+		intern_free(pool);
+		pass("interned and copied keys freed correctly");
+	}
+
 	alarm(0);
 	done_testing();
 }
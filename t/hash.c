@@ -19,6 +19,34 @@
 
 #include "test.h"
 
+static uint64_t collide(const void *key, size_t len, uint64_t seed)
+{
+	return 42;
+}
+
+static void* count_keys(void *h)
+{
+	hash_iter_t it;
+	char *k; void *v;
+	size_t n = 0;
+	for_each_key_value_iter(it, (const hash_t *)h, k, v)
+		if (hash_get(h, k) == v) n++;
+	return (void*)n;
+}
+
+static void* fill_chash(void *ch)
+{
+	char key[64];
+	size_t i;
+	for (i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "t%lx:%lu", (unsigned long)pthread_self(), i);
+		chash_set(ch, key, (void*)(i + 1));
+		if (chash_get(ch, key) != (void*)(i + 1))
+			return (void*)1;
+	}
+	return NULL;
+}
+
 TESTS {
 	alarm(5);
 	subtest {
@@ -232,6 +260,426 @@ TESTS {
 		hash_done(&h, 0);
 	}
 
+	subtest {
+		hash_t h;
+		memset(&h, 0, sizeof(h));
+
+		char key[32];
+		size_t i, n, bad;
+
+		for (i = 0; i < 5000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			hash_set(&h, key, (void*)(i + 1));
+		}
+		is_int(hash_len(&h), 5000, "hash grew to hold 5k keys");
+
+		for (bad = i = 0; i < 5000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			if (hash_get(&h, key) != (void*)(i + 1)) bad++;
+		}
+		is_int(bad, 0, "all 5k keys retrievable after growth");
+
+		for (i = 0; i < 5000; i += 2) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			hash_unset(&h, key);
+		}
+		is_int(hash_len(&h), 2500, "unset half of the keys");
+
+		for (bad = i = 0; i < 5000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			if (hash_get(&h, key) != (i % 2 ? (void*)(i + 1) : NULL)) bad++;
+		}
+		is_int(bad, 0, "odd keys remain, even keys are gone");
+
+		char *k; void *v;
+		n = 0;
+		for_each_key_value(&h, k, v)
+			n++;
+		is_int(n, 2500, "for_each_key_value visits every remaining key");
+
+		hash_done(&h, 0);
+		is_int(hash_len(&h), 0, "hash_done() empties the hash");
+		is_null(hash_get(&h, "key1"), "hash_get() after hash_done() finds nothing");
+		hash_set(&h, "reused", "yes");
+		is_string(hash_get(&h, "reused"), "yes", "hash can be re-used after hash_done()");
+		hash_done(&h, 0);
+	}
+
+	subtest {
+		uint64_t a = hash64("a key", 5, 1);
+		ok(a == hash64("a key", 5, 1), "hash64() is deterministic");
+		ok(a != hash64("a key", 5, 2), "hash64() depends on the seed");
+		ok(a != hash64("a kez", 5, 1), "hash64() depends on the key");
+		ok(hash64("", 0, 1) != hash64("", 0, 2), "hash64() handles empty keys");
+
+		char buf[100];
+		memset(buf, 'x', sizeof(buf));
+		ok(hash64(buf, 100, 1) != hash64(buf, 99, 1), "hash64() handles long keys");
+	}
+
+	subtest {
+		hash_t h;
+		memset(&h, 0, sizeof(h));
+
+		char key[32];
+		size_t i, bad;
+
+		uint64_t seed = 0xdecafbad;
+		is_int(hash_setopt(&h, VIGOR_HASH_SEED, &seed), 0, "set an explicit seed");
+		is_int(hash_setopt(&h, VIGOR_HASH_FUNCTION, collide), 0, "set a custom hash function");
+		is_int(hash_setopt(&h, 42, NULL), 1, "unknown hash_setopt() op fails");
+		is_int(errno, EINVAL, "unknown op sets errno to EINVAL");
+
+		for (i = 0; i < 1000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			hash_set(&h, key, (void*)(i + 1));
+		}
+		is_int(hash_len(&h), 1000, "1000 keys with identical hashes inserted");
+		ok(h.seed == seed, "explicit seed was kept");
+
+		for (bad = i = 0; i < 1000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			if (hash_get(&h, key) != (void*)(i + 1)) bad++;
+		}
+		is_int(bad, 0, "colliding keys are told apart by strcmp()");
+		is_null(hash_get(&h, "key1000"), "missing key with colliding hash not found");
+
+		is_int(hash_setopt(&h, VIGOR_HASH_FUNCTION, NULL), 1, "can't change hash function of a non-empty hash");
+		is_int(errno, EBUSY, "hash_setopt() on non-empty hash sets errno to EBUSY");
+
+		hash_done(&h, 0);
+		ok(h.hashfn == NULL, "hash_done() restores the default hash function");
+
+		hash_set(&h, "key", "value");
+		ok(h.seed != 0, "a random seed is chosen on first use");
+		hash_done(&h, 0);
+	}
+
+	subtest {
+		hash_t h;
+		memset(&h, 0, sizeof(h));
+
+		char key[32], *k;
+		void *v;
+		size_t i, n, bad, step = 4;
+		int migrating = 0;
+
+		is_int(hash_setopt(&h, VIGOR_HASH_INCREMENTAL, &step), 0, "enabled incremental rehashing");
+
+		for (bad = i = 0; i < 10000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			hash_set(&h, key, (void*)(i + 1));
+
+			if (!h.old.cap)
+				continue;
+			migrating++;
+
+			/* check that no key is lost, or seen twice, mid-migration */
+			if (i % 97 == 0) {
+				n = 0;
+				for_each_key_value(&h, k, v) {
+					if (hash_get(&h, k) != v) bad++;
+					n++;
+				}
+				if (n != i + 1) bad++;
+			}
+		}
+		ok(migrating > 0, "hash was caught mid-migration");
+		is_int(bad, 0, "every key visited exactly once during migrations");
+		is_int(hash_len(&h), 10000, "10k keys inserted incrementally");
+
+		for (bad = i = 0; i < 10000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			if (hash_get(&h, key) != (void*)(i + 1)) bad++;
+		}
+		is_int(bad, 0, "all keys retrievable");
+
+		for (i = 0; i < 10000; i += 3) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			hash_unset(&h, key);
+		}
+		for (bad = i = 0; i < 10000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			if (hash_get(&h, key) != (i % 3 ? (void*)(i + 1) : NULL)) bad++;
+		}
+		is_int(bad, 0, "unset keys are gone, others remain");
+
+		step = 0;
+		is_int(hash_setopt(&h, VIGOR_HASH_INCREMENTAL, &step), 0, "disabled incremental rehashing");
+		ok(h.old.cap == 0, "disabling incremental rehashing finishes the migration");
+
+		hash_done(&h, 0);
+	}
+
+	subtest { /* incremental rehashing never stalls */
+		hash_t h;
+		memset(&h, 0, sizeof(h));
+
+		char key[32];
+		size_t i, start = 0, cap = 0, early = 0, step = 1;
+
+		hash_setopt(&h, VIGOR_HASH_INCREMENTAL, &step);
+		is_int(h.step, 4, "incremental steps below 4 are rounded up");
+
+		for (i = 0; i < 20000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			hash_set(&h, key, (void*)(i + 1));
+
+			if (h.old.cap == cap)
+				continue;
+			/* a migration of $cap slots, started at insert $start,
+			   must take cap / step inserts to drain */
+			if (cap && i - start < cap / h.step) early++;
+			start = i;
+			cap = h.old.cap;
+		}
+		is_int(early, 0, "no migration finished all at once");
+		hash_done(&h, 0);
+	}
+
+	subtest {
+		hash_t h;
+		memset(&h, 0, sizeof(h));
+
+		char key[32], *k1, *k2;
+		void *v1, *v2;
+		size_t i, n;
+
+		for (i = 0; i < 100; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			hash_set(&h, key, (void*)(i + 1));
+		}
+
+		hash_iter_t outer, inner;
+		n = 0;
+		for_each_key_value_iter(outer, &h, k1, v1)
+			for_each_key_value_iter(inner, &h, k2, v2)
+				n++;
+		is_int(n, 100 * 100, "nested iterators visit every pair of keys");
+
+		pthread_t tid[4];
+		void *seen;
+		for (i = 0; i < 4; i++)
+			pthread_create(&tid[i], NULL, count_keys, &h);
+		for (n = i = 0; i < 4; i++) {
+			pthread_join(tid[i], &seen);
+			n += (size_t)seen;
+		}
+		is_int(n, 4 * 100, "4 threads iterated the same hash at once");
+		is_int(h.bucket, 0, "external iterators don't touch the hash's own cursor");
+
+		hash_done(&h, 0);
+	}
+
+	subtest {
+		chash_t *ch;
+
+		isnt_null(ch = chash_new(3), "chash_new() -> pointer");
+		is_int(ch->n, 4, "shard count rounded up to a power of two");
+
+		is_null(chash_get(ch, "key"), "can't get 'key' prior to set");
+		ok(chash_set(ch, "key", "value") == (void*)"value", "set ch.key");
+		is_string(chash_get(ch, "key"), "value", "get ch.key");
+		is_string(chash_set(ch, "key", "other"), "value", "chash_set() returns prior value");
+		is_int(chash_len(ch), 1, "chash_len() counts across shards");
+		is_string(chash_unset(ch, "key"), "other", "chash_unset() returns removed value");
+		is_null(chash_get(ch, "key"), "'key' is gone after unset");
+		is_int(chash_len(ch), 0, "chash is empty again");
+
+		chash_free(ch, 0);
+		chash_free(NULL, 0);
+	}
+
+	subtest {
+		chash_t *ch = chash_new(0);
+		pthread_t tid[8];
+		void *failed;
+		size_t i, bad = 0;
+
+		for (i = 0; i < 8; i++)
+			pthread_create(&tid[i], NULL, fill_chash, ch);
+		for (i = 0; i < 8; i++) {
+			pthread_join(tid[i], &failed);
+			if (failed) bad++;
+		}
+		is_int(bad, 0, "8 threads set and got their own keys");
+		is_int(chash_len(ch), 8 * 10000, "all keys from all threads are present");
+
+		chash_free(ch, 0);
+	}
+
+	subtest {
+		hash_t h;
+		memset(&h, 0, sizeof(h));
+
+		char key[32];
+		size_t i, bad;
+		int on = 1;
+
+		is_int(hash_setopt(&h, VIGOR_HASH_ARENA, &on), 0, "enabled arena key storage");
+		isnt_null(h.arena, "hash has an arena");
+
+		for (i = 0; i < 10000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			hash_set(&h, key, strdup(key));
+		}
+		for (i = 0; i < 10000; i += 2) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			free(hash_unset(&h, key));
+		}
+		for (bad = i = 0; i < 10000; i++) {
+			snprintf(key, sizeof(key), "key%lu", i);
+			char *v = hash_get(&h, key);
+			if (i % 2 ? !v || strcmp(v, key) != 0 : v != NULL) bad++;
+		}
+		is_int(bad, 0, "arena-backed keys behave like strdup'd keys");
+
+		is_int(hash_setopt(&h, VIGOR_HASH_ARENA, &on), 1, "can't swap arenas on a non-empty hash");
+
+		hash_done(&h, 1);
+		is_null(h.arena, "hash_done() releases the arena");
+	}
+
+	subtest { /* integer keys */
+		ihash_t h;
+		hash_iter_t it;
+		uint64_t k, sum = 0;
+		void *v;
+		size_t i, bad, n = 0;
+
+		memset(&h, 0, sizeof(h));
+		is_null(ihash_get(&h, 0), "empty ihash has no keys");
+
+		for (i = 0; i < 50000; i++)
+			ihash_set(&h, i * 0x100000001ull, (void *)(i + 1));
+		is_int(ihash_len(&h), 50000, "ihash has 50k keys");
+		is_null(ihash_get(&h, 7), "ihash_get() misses an unset key");
+		is_ptr(ihash_get(&h, 0), (void *)1, "key 0 is a valid integer key");
+
+		is_ptr(ihash_set(&h, 0, (void *)42), (void *)1, "overwriting returns the prior value");
+		is_ptr(ihash_unset(&h, 0), (void *)42, "ihash_unset() returns the value");
+		is_null(ihash_get(&h, 0), "unset key is gone");
+
+		for (bad = 0, i = 1; i < 50000; i++)
+			if (ihash_get(&h, i * 0x100000001ull) != (void *)(i + 1)) bad++;
+		is_int(bad, 0, "all remaining integer keys found");
+
+		for_each_ihash_key_value(it, &h, k, v) {
+			if (v != (void *)(k / 0x100000001ull + 1)) bad++;
+			sum += (uintptr_t)v;
+			n++;
+		}
+		is_int(n, 49999, "iterated over every integer key");
+		is_int(bad, 0, "iterated keys match their values");
+		is_int(sum, 50000ull * 50001 / 2 - 1, "each key visited once");
+
+		ihash_done(&h, 0);
+		is_int(ihash_len(&h), 0, "ihash_done() empties the hash");
+	}
+
+	subtest { /* freeing values alongside integer key 0 */
+		ihash_t h;
+		size_t i;
+
+		memset(&h, 0, sizeof(h));
+		for (i = 0; i < 1000; i++)
+			ihash_set(&h, i, strdup("value"));
+		is_int(ihash_len(&h), 1000, "ihash has 1000 keys, including 0");
+
+		/* run under a leak checker, this catches hash_done()
+		   stopping early, when it sees key 0 as a NULL key */
+		ihash_done(&h, 1);
+		is_int(ihash_len(&h), 0, "ihash_done() frees every value");
+	}
+
+	subtest { /* binary keys */
+		bhash_t h;
+		hash_iter_t it;
+		const void *k;
+		size_t len, n = 0;
+		void *v;
+		char a[] = { 'a', '\0', 'b' };
+		char b[] = { 'a', '\0', 'c' };
+
+		memset(&h, 0, sizeof(h));
+		is_ptr(bhash_set(&h, a, 3, "A"), "A", "set key with an embedded NUL");
+		is_ptr(bhash_set(&h, b, 3, "B"), "B", "set a key differing after the NUL");
+		is_ptr(bhash_set(&h, a, 1, "a"), "a", "a key's prefix is a different key");
+		is_ptr(bhash_set(&h, "", 0, "empty"), "empty", "the empty key is a valid key");
+		is_int(bhash_len(&h), 4, "bhash has 4 keys");
+
+		is_string(bhash_get(&h, a, 3), "A", "found a\\0b");
+		is_string(bhash_get(&h, b, 3), "B", "found a\\0c");
+		is_string(bhash_get(&h, "a", 1), "a", "found a");
+		is_string(bhash_get(&h, NULL, 0), "empty", "found the empty key");
+		is_null(bhash_get(&h, "a\0", 2), "a\\0 is not set");
+
+		a[2] = 'z';
+		is_null(bhash_get(&h, a, 3), "keys are copied on insert");
+		a[2] = 'b';
+
+		for_each_bhash_key_value(it, &h, k, len, v) {
+			if (bhash_get(&h, k, len) == v) n++;
+		}
+		is_int(n, 4, "iterated over every binary key");
+
+		is_string(bhash_unset(&h, b, 3), "B", "bhash_unset() returns the value");
+		is_null(bhash_get(&h, b, 3), "unset key is gone");
+		is_string(bhash_get(&h, a, 3), "A", "other keys unaffected");
+
+		bhash_done(&h, 0);
+		is_int(bhash_len(&h), 0, "bhash_done() empties the hash");
+	}
+
+	subtest { /* interned keys */
+		hash_t a, b;
+		hash_iter_t it;
+		intern_t *pool = intern_new();
+		char *k, *v, buf[16];
+
+		memset(&a, 0, sizeof(a));
+		memset(&b, 0, sizeof(b));
+		is_int(hash_setopt(&a, VIGOR_HASH_INTERN, pool), 0, "set intern pool on hash a");
+		is_int(hash_setopt(&b, VIGOR_HASH_INTERN, pool), 0, "set intern pool on hash b");
+
+		strcpy(buf, "type");
+		hash_set(&a, buf, "PING");
+		hash_set(&b, "type", "PONG");
+		is_int(intern_len(pool), 1, "both hashes share one interned key");
+		is_string(hash_get(&a, "type"), "PING", "a[type]");
+		is_string(hash_get(&b, intern(pool, "type")), "PONG", "b[type], via the canonical key");
+
+		for_each_key_value_iter(it, &a, k, v)
+			ok(k == intern_find(pool, "type"), "hash keys are the canonical copies");
+
+		is_string(hash_unset(&a, "type"), "PING", "unset interned key");
+		is_int(intern_len(pool), 1, "interned strings outlive their hashes' keys");
+		is_int(hash_setopt(&b, VIGOR_HASH_INTERN, NULL), 1, "can't change pools on a non-empty hash");
+
+		hash_done(&a, 0);
+		hash_done(&b, 0);
+		intern_free(pool);
+	}
+
+	subtest { /* binary keys, with an intern pool */
+		bhash_t h;
+		intern_t *pool = intern_new();
+
+		memset(&h, 0, sizeof(h));
+		is_int(bhash_setopt(&h, VIGOR_HASH_INTERN, pool), 0, "set intern pool on a bhash");
+		bhash_set(&h, "a\0b", 3, "A");
+		bhash_set(&h, "c", 1, "C");
+		is_string(bhash_get(&h, "a\0b", 3), "A", "found a\\0b");
+		is_int(intern_len(pool), 0, "binary keys aren't interned");
+
+		/* run under a leak checker, this catches the copied keys
+		   not being freed on unset / done */
+		is_string(bhash_unset(&h, "c", 1), "C", "unset a copied key");
+		bhash_done(&h, 0);
+		intern_free(pool);
+		pass("copied binary keys freed correctly");
+	}
+
 	alarm(0);
 	done_testing();
 }
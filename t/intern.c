@@ -0,0 +1,96 @@
+/*
+  Copyright 2016 James Hunt <james@jameshunt.us>
+
+  This file is part of libvigor.
+
+  libvigor is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libvigor is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libvigor.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+static void* intern_words(void *pool)
+{
+	char word[32];
+	size_t i, bad = 0;
+
+	for (i = 0; i < 10000; i++) {
+		snprintf(word, sizeof(word), "word%lu", i % 500);
+		const char *c = intern(pool, word);
+		if (!c || strcmp(c, word) != 0 || intern_find(pool, word) != c) bad++;
+	}
+	return (void *)bad;
+}
+
+TESTS {
+	alarm(5);
+	subtest {
+		intern_t *pool = intern_new();
+		char buf[16];
+
+		isnt_null(pool, "intern_new() returns a new pool");
+		is_int(intern_len(pool), 0, "new pool is empty");
+		is_null(intern_find(pool, "PING"), "nothing interned yet");
+
+		const char *ping = intern(pool, "PING");
+		isnt_null(ping, "interned PING");
+		is_string(ping, "PING", "canonical copy is equal to the original");
+
+		strcpy(buf, "PING");
+		ok(intern(pool, buf) == ping, "interning an equal string returns the same pointer");
+		ok(intern_find(pool, buf) == ping, "intern_find() returns the canonical copy");
+		ok(intern(pool, "PONG") != ping, "different strings get different pointers");
+		is_int(intern_len(pool), 2, "pool has two strings");
+
+		ok(intern_find_n(pool, "PINGPONG", 4) == ping, "intern_find_n() finds a prefix");
+		is_null(intern_find_n(pool, "PINGPONG", 8), "intern_find_n() doesn't add strings");
+		ok(intern_n(pool, "PINGPONG", 4) == ping, "intern_n() interns a prefix");
+		ok(intern_n(pool, "PINGPONG", 8) != ping, "PINGPONG isn't PING");
+		is_string(intern_n(pool, "PINGPONG", 8), "PINGPONG", "intern_n() canonical copy is NUL-terminated");
+		ok(intern(pool, "") != NULL, "the empty string can be interned");
+
+		is_null(intern(pool, NULL), "can't intern NULL");
+		is_null(intern_find(pool, NULL), "can't find NULL");
+
+		intern_free(pool);
+		intern_free(NULL);
+		pass("intern_free(NULL) is a no-op");
+	}
+
+	subtest { /* global pool */
+		isnt_null(intern_global(), "there's always a global pool");
+		ok(intern_global() == intern_global(), "there's only one global pool");
+		ok(intern(intern_global(), "global") == intern(intern_global(), "global"),
+			"global pool interns strings");
+	}
+
+	subtest { /* threads */
+		intern_t *pool = intern_new();
+		pthread_t tid[4];
+		void *bad;
+		size_t i, total = 0;
+
+		for (i = 0; i < 4; i++)
+			pthread_create(&tid[i], NULL, intern_words, pool);
+		for (i = 0; i < 4; i++) {
+			pthread_join(tid[i], &bad);
+			total += (size_t)bad;
+		}
+		is_int(total, 0, "4 threads agree on canonical copies");
+		is_int(intern_len(pool), 500, "each word interned once");
+		intern_free(pool);
+	}
+
+	alarm(0);
+	done_testing();
+}
@@ -137,6 +137,10 @@ TESTS {
 		is_int(log_level_number("info"),      LOG_INFO,    "info == LOG_INFO");
 		is_int(log_level_number("debug"),     LOG_DEBUG,   "debug == LOG_DEBUG");
 		is_int(log_level_number("whatever"),  -1,          "unknown log level == -1");
+		is_int(log_level_number("warnin"),    -1,          "prefix of a log level == -1");
+		is_int(log_level_number("DEBUG"),     -1,          "log levels are case-sensitive");
+		is_int(log_level_number(""),          -1,          "empty log level == -1");
+		is_int(log_level_number(NULL),        -1,          "NULL log level == -1");
 
 		is_string(log_level_name(LOG_EMERG),   "emergency", "LOG_EMERG == emergency");
 		is_string(log_level_name(LOG_ALERT),   "alert",     "LOG_ALERT == alert");
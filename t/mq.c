@@ -36,6 +36,33 @@ TESTS {
 		pdu_free(p);
 	}
 
+	subtest { /* interned pdu types */
+		intern_t *pool = intern_new();
+		const char *ping = intern(pool, "PING");
+
+		pdu_t *a = pdu_make("PING", 0);
+		pdu_t *b = pdu_make("PING", 1, "again");
+		pdu_t *c = pdu_make("PONG", 0);
+		pdu_t *d = pdu_make("PING", 0);
+
+		is_string(pdu_type_interned(a, pool), "PING", "interned type");
+		ok(pdu_type_interned(a, pool) == pdu_type_interned(b, pool), "same PDU types share one string");
+		ok(pdu_type_interned(a, pool) == ping, "PDU type is the canonical copy");
+		ok(pdu_type(a) == ping, "pdu_type() returns the canonical copy, once interned");
+		is_string(pdu_type_interned(c, pool), "PONG", "unknown type is copied");
+		ok(pdu_type(a) != pdu_type(c), "different PDU types don't share");
+		is_int(intern_len(pool), 1, "unknown PDU types aren't interned");
+
+		ok(pdu_type(d) != ping, "pdu_type() copies the type");
+		ok(pdu_type_interned(d, pool) == ping, "a copied type can still be interned later");
+
+		pdu_free(a);
+		pdu_free(b);
+		pdu_free(c);
+		pdu_free(d);
+		intern_free(pool);
+	}
+
 	subtest { /* pdu construction */
 		pdu_t *p = pdu_make("ERROR", 2, "404", "Not Found");
 		isnt_null(p, "pdu_make() returns a valid pdu handle");
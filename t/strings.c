@@ -517,6 +517,177 @@ TESTS {
 		strings_free(Y);
 	}
 
+	subtest {
+		// test reservation
+		strings_t *sl;
+		char **was, buf[32];
+		size_t i, len;
+
+		isnt_null(sl = strings_new(NULL), "created a stringlist");
+		ok(strings_reserve(sl, 1000) == 0, "reserved room for 1000 strings");
+		ok(sl->len > 1000, "list has room for 1000 strings (and a NULL)");
+		is_int(sl->num, 0, "list is still empty");
+
+		was = sl->strings; len = sl->len;
+		for (i = 0; i < 1000; i++) {
+			snprintf(buf, 32, "string%u", (unsigned int)i);
+			strings_add(sl, buf);
+		}
+		is_int(sl->num, 1000, "added 1000 strings");
+		ok(sl->strings == was && sl->len == len, "list was not re-allocated");
+		is_null(sl->strings[1000], "list is NULL-terminated");
+
+		ok(strings_reserve(sl, 10) == 0, "reserving less room than the list has");
+		is_int(sl->len, len, "...does nothing");
+
+		while (sl->num < len - 1)
+			strings_add(sl, "filler");
+		ok(strings_add(sl, "one more") == 0, "added one more string to a full list");
+		ok(sl->len >= 2 * len, "list grew geometrically");
+		is_string(sl->strings[sl->num - 1], "one more", "new string was added");
+		is_null(sl->strings[sl->num], "list is NULL-terminated");
+
+		strings_free(sl);
+	}
+
+	subtest {
+		// splitting lots of lines
+		strings_t *sl;
+		char *buf;
+		size_t i, n = 100000;
+
+		buf = calloc(n, 8);
+		for (i = 0; i < n; i++)
+			memcpy(buf + i * 8, "a line\n", 7);
+		for (i = 0; i < n; i++)
+			buf[i * 8 + 7] = '\n';
+
+		isnt_null(sl = strings_split(buf, n * 8, "\n", SPLIT_GREEDY), "split 100k lines");
+		is_int(sl->num, n, "got 100k lines");
+		is_string(sl->strings[n - 1], "a line", "last line");
+		strings_free(sl);
+		free(buf);
+	}
+
+	subtest {
+		// arena-backed lists
+		strings_t *sl, *dup;
+		char *src[] = { "fig", "apple", "fig", "banana", NULL };
+
+		isnt_null(sl = strings_new_arena(src), "strings_new_arena() returns a list");
+		is_int(sl->num, 4, "arena list has all 4 strings");
+		is_string(sl->strings[0], "fig", "first string copied in");
+		ok(sl->strings[0] != src[0], "strings are copied, not borrowed");
+		ok(sl->strings[1] > sl->strings[0] && sl->strings[1] < sl->strings[0] + 64,
+			"strings are packed together");
+
+		ok(strings_add(sl, "cherry") == 0, "added a string to an arena list");
+		is_int(sl->num, 5, "arena list has 5 strings");
+		ok(strings_remove(sl, "apple") == 0, "removed a string from an arena list");
+		is_int(sl->num, 4, "arena list has 4 strings");
+		strings_uniq(sl);
+		is_int(sl->num, 3, "uniq works on arena lists");
+
+		isnt_null(dup = strings_dup(sl), "duplicated an arena list");
+		isnt_null(dup->arena, "duplicate is arena-backed too");
+		is_int(dup->num, sl->num, "duplicate has as many strings as the original");
+		strings_free(sl);
+		is_string(dup->strings[0], "banana", "duplicate has its own storage");
+		strings_free(dup);
+
+		isnt_null(sl = strings_split("a::b:c", 6, ":", SPLIT_NORMAL | SPLIT_ARENA), "split into an arena list");
+		isnt_null(sl->arena, "split list is arena-backed");
+		is_int(sl->num, 4, "SPLIT_NORMAL | SPLIT_ARENA keeps empty tokens");
+		strings_free(sl);
+
+		isnt_null(sl = strings_split("a::b:c", 6, ":", SPLIT_GREEDY | SPLIT_ARENA), "split into an arena list");
+		is_int(sl->num, 3, "SPLIT_GREEDY | SPLIT_ARENA drops empty tokens");
+		is_string(sl->strings[2], "c", "last token");
+		strings_free(sl);
+	}
+
+	subtest {
+		// string views
+		strview_t v;
+		char *s;
+
+		v = strview("hello");
+		is_int(v.len, 5, "strview() measures its string");
+		ok(strview_eq(v, "hello"), "view is equal to its string");
+		ok(!strview_eq(v, "hell"), "view is not equal to a prefix");
+		ok(!strview_eq(v, "hello!"), "view is not equal to a longer string");
+
+		v.len = 4;
+		ok(strview_eq(v, "hell"), "shortened view is equal to a prefix");
+		isnt_null(s = strview_dup(v), "strview_dup() copies a view");
+		is_string(s, "hell", "copy is NUL-terminated at the end of the view");
+		free(s);
+
+		v.ptr = "ab\0cd";
+		v.len = 5;
+		ok(!strview_eq(v, "ab"), "view with an embedded NUL is not equal to its prefix");
+		ok(!strview_eq(v, "abxcd"), "view with an embedded NUL is not equal to a same-length string");
+
+		v = strview(NULL);
+		is_int(v.len, 0, "view of NULL is empty");
+		ok(strview_eq(v, ""), "empty view is equal to the empty string");
+	}
+
+	subtest {
+		// non-allocating splitter
+		const char *buf = "one::two::::three::XX";
+		strsplit_t it;
+		strview_t tok;
+
+		strsplit_init(&it, buf, 19, "::", SPLIT_NORMAL);
+		ok(strsplit_next(&it, &tok), "got first token");
+		ok(strview_eq(tok, "one"), "first token is 'one'");
+		ok(tok.ptr == buf, "token points into the original buffer");
+		ok(strsplit_next(&it, &tok) && strview_eq(tok, "two"), "second token is 'two'");
+		ok(strsplit_next(&it, &tok) && strview_eq(tok, ""), "SPLIT_NORMAL yields empty tokens");
+		ok(strsplit_next(&it, &tok) && strview_eq(tok, "three"), "fourth token is 'three'");
+		ok(!strsplit_next(&it, &tok), "no tokens past $len");
+		ok(!strsplit_next(&it, &tok), "splitter stays done");
+
+		strsplit_init(&it, buf, 19, "::", SPLIT_GREEDY);
+		ok(strsplit_next(&it, &tok) && strview_eq(tok, "one"), "greedy: 'one'");
+		ok(strsplit_next(&it, &tok) && strview_eq(tok, "two"), "greedy: 'two'");
+		ok(strsplit_next(&it, &tok) && strview_eq(tok, "three"), "greedy: skips empty tokens");
+		ok(!strsplit_next(&it, &tok), "greedy: no more tokens");
+
+		strsplit_init(&it, "a:b:", 3, "::", SPLIT_NORMAL);
+		ok(strsplit_next(&it, &tok) && strview_eq(tok, "a:b"), "delimiter can't straddle $len");
+		ok(!strsplit_next(&it, &tok), "only one token");
+
+		strsplit_init(&it, "a,b", 3, "", SPLIT_NORMAL);
+		ok(strsplit_next(&it, &tok) && strview_eq(tok, "a,b"), "empty delimiter yields the whole string");
+		ok(!strsplit_next(&it, &tok), "only one token");
+
+		strsplit_init(&it, "", 0, ",", SPLIT_NORMAL);
+		ok(!strsplit_next(&it, &tok), "empty string has no tokens");
+	}
+
+	subtest {
+		// view-accepting list calls
+		strings_t *sl;
+		strsplit_t it;
+		strview_t tok;
+
+		isnt_null(sl = strings_new(NULL), "created a list");
+		strsplit_init(&it, "x=1 y=2 z=3", 11, " ", SPLIT_GREEDY);
+		while (strsplit_next(&it, &tok))
+			ok(strings_add_view(sl, tok) == 0, "added a view to the list");
+		is_int(sl->num, 3, "list has 3 strings");
+		is_string(sl->strings[1], "y=2", "views are copied and NUL-terminated");
+
+		tok.ptr = "y=2 and then some";
+		tok.len = 3;
+		ok(strings_search_view(sl, tok) == 0, "found a view in the list");
+		tok.len = 2;
+		ok(strings_search_view(sl, tok) != 0, "prefixes don't count");
+		strings_free(sl);
+	}
+
 	subtest {
 		char *s;
 
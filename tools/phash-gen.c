@@ -0,0 +1,287 @@
+/*
+  Copyright 2016 James Hunt <james@jameshunt.us>
+
+  This file is part of libvigor.
+
+  libvigor is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  libvigor is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with libvigor.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  phash-gen - generate a minimal perfect hash for a fixed set of strings
+
+  usage: phash-gen [-t TYPE] NAME [FILE]
+
+  Reads keys (one per line) from FILE, or standard input, and
+  writes C source for a `phash_t` called NAME to standard output.
+  Blank lines and lines starting with '#' are ignored.  Anything
+  after the first run of whitespace on a line is taken as a C
+  expression for that key's value, and collected into an array
+  of TYPE (default: int) called NAME_values, in slot order:
+
+      # log level names
+      emerg      LOG_EMERG
+      emergency  LOG_EMERG
+      ...
+
+  Look keys up with phash_find(&NAME, key), which returns the
+  key's slot, or -1 if it isn't one of the keys in the set.
+
+  Tables use "hash and displace": each key is hashed once; the
+  top half of the hash picks a bucket, and the bucket's pair of
+  displacements (d0, d1) moves the key to slot f1 + d0 * f2 + d1
+  (mod n), where f1 and f2 also come from the hash.  Buckets are
+  placed largest-first, trying every displacement pair until all
+  of a bucket's keys land in free slots.  If that fails, we start
+  over with a new seed.
+
+  This tool is run at build time, so it only uses the in-line
+  parts of vigor.h, and does not link against libvigor.
+ */
+
+#include <vigor.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#define MAX_KEYS  0xffff
+#define MAX_TRIES 10000
+
+struct key {
+	char     *key;
+	char     *value;
+	uint64_t  hash;
+	uint32_t  bucket;
+	uint32_t  slot;
+};
+
+static struct key *KEYS;
+static uint32_t    N;
+static uint32_t   *SIZES; /* keys per bucket */
+
+static int s_read(FILE *io)
+{
+	char line[8192];
+	size_t cap = 0;
+
+	while (fgets(line, sizeof(line), io)) {
+		char *k = line, *v, *end;
+
+		while (isspace((unsigned char)*k)) k++;
+		if (!*k || *k == '#')
+			continue;
+
+		for (v = k; *v && !isspace((unsigned char)*v); v++)
+			;
+		if (*v) *v++ = '\0';
+		while (isspace((unsigned char)*v)) v++;
+		for (end = v + strlen(v); end > v && isspace((unsigned char)end[-1]); end--)
+			;
+		*end = '\0';
+
+		if (N == MAX_KEYS) {
+			fprintf(stderr, "phash-gen: too many keys (max %u)\n", MAX_KEYS);
+			return 1;
+		}
+		if (N == cap) {
+			cap = cap ? cap * 2 : 64;
+			KEYS = realloc(KEYS, cap * sizeof(struct key));
+			if (!KEYS) return 1;
+		}
+		KEYS[N].key   = strdup(k);
+		KEYS[N].value = *v ? strdup(v) : NULL;
+		N++;
+	}
+	return ferror(io) ? 1 : 0;
+}
+
+static int s_by_key(const void *a, const void *b)
+{
+	return strcmp(((const struct key *)a)->key, ((const struct key *)b)->key);
+}
+
+static int s_dupes(void)
+{
+	uint32_t i;
+	qsort(KEYS, N, sizeof(struct key), s_by_key);
+	for (i = 1; i < N; i++)
+		if (strcmp(KEYS[i - 1].key, KEYS[i].key) == 0) {
+			fprintf(stderr, "phash-gen: duplicate key '%s'\n", KEYS[i].key);
+			return 1;
+		}
+	return 0;
+}
+
+static int s_by_bucket_size(const void *a, const void *b)
+{
+	const struct key *x = a, *y = b;
+	if (SIZES[x->bucket] != SIZES[y->bucket])
+		return SIZES[x->bucket] > SIZES[y->bucket] ? -1 : 1;
+	return x->bucket < y->bucket ? -1 : x->bucket > y->bucket;
+}
+
+/* Try to place every key, using $ph->seed; fills in $ph->disp. */
+static int s_place(phash_t *ph, uint32_t *disp, uint8_t *taken)
+{
+	uint32_t i, j, b, d0, d1, *sizes = SIZES;
+
+	memset(sizes, 0, ph->nb * sizeof(uint32_t));
+	memset(disp,  0, ph->nb * sizeof(uint32_t));
+	memset(taken, 0, ph->n);
+
+	for (i = 0; i < N; i++) {
+		KEYS[i].hash   = phash64(KEYS[i].key, strlen(KEYS[i].key), ph->seed);
+		KEYS[i].bucket = (KEYS[i].hash >> 32) % ph->nb;
+		sizes[KEYS[i].bucket]++;
+	}
+	qsort(KEYS, N, sizeof(struct key), s_by_bucket_size);
+
+	for (i = 0; i < N; i += sizes[b]) {
+		b = KEYS[i].bucket;
+		for (d0 = 0; d0 < ph->n; d0++) {
+			for (d1 = 0; d1 < ph->n; d1++) {
+				disp[b] = d0 << 16 | d1;
+				for (j = 0; j < sizes[b]; j++) {
+					KEYS[i + j].slot = phash_slot(ph, KEYS[i + j].hash);
+					if (taken[KEYS[i + j].slot])
+						break;
+					taken[KEYS[i + j].slot] = 1;
+				}
+				if (j == sizes[b])
+					goto placed;
+				while (j-- > 0)
+					taken[KEYS[i + j].slot] = 0;
+			}
+		}
+		return 1;
+placed:
+		continue;
+	}
+	return 0;
+}
+
+static void s_cstring(FILE *io, const char *s)
+{
+	fputc('"', io);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(io, "\\%c", *s);
+		else if (isprint((unsigned char)*s))
+			fputc(*s, io);
+		else
+			fprintf(io, "\\%03o", (unsigned char)*s);
+	}
+	fputc('"', io);
+}
+
+static void s_write(FILE *io, const phash_t *ph, const char *name, const char *type, const char *src)
+{
+	uint32_t i, *slots = calloc(ph->n, sizeof(uint32_t));
+	int values = 0;
+
+	for (i = 0; i < N; i++) {
+		slots[KEYS[i].slot] = i;
+		if (KEYS[i].value) values = 1;
+	}
+
+	fprintf(io, "/* generated by phash-gen from %s; do not edit */\n\n", src);
+
+	fprintf(io, "static const char *%s_keys[%u] = {\n", name, ph->n);
+	for (i = 0; i < ph->n; i++) {
+		fprintf(io, "\t");
+		s_cstring(io, KEYS[slots[i]].key);
+		fprintf(io, ",\n");
+	}
+	fprintf(io, "};\n\n");
+
+	if (values) {
+		fprintf(io, "static const %s %s_values[%u] = {\n", type, name, ph->n);
+		for (i = 0; i < ph->n; i++)
+			fprintf(io, "\t%s,\n", KEYS[slots[i]].value ? KEYS[slots[i]].value : "0");
+		fprintf(io, "};\n\n");
+	}
+
+	fprintf(io, "static const uint32_t %s_disp[%u] = {", name, ph->nb);
+	for (i = 0; i < ph->nb; i++)
+		fprintf(io, "%s0x%08x,", i % 6 ? " " : "\n\t", ph->disp[i]);
+	fprintf(io, "\n};\n\n");
+
+	fprintf(io, "static const phash_t %s = {\n"
+	            "\t.seed = 0x%016llxull,\n"
+	            "\t.n    = %u,\n"
+	            "\t.nb   = %u,\n"
+	            "\t.disp = %s_disp,\n"
+	            "\t.keys = %s_keys,\n"
+	            "};\n",
+		name, (unsigned long long)ph->seed, ph->n, ph->nb, name, name);
+
+	free(slots);
+}
+
+int main(int argc, char **argv)
+{
+	const char *type = "int", *name, *src = "<stdin>";
+	FILE *io = stdin;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:")) != -1) {
+		switch (opt) {
+		case 't': type = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-t TYPE] NAME [FILE]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc || optind + 2 < argc) {
+		fprintf(stderr, "usage: %s [-t TYPE] NAME [FILE]\n", argv[0]);
+		return 1;
+	}
+	name = argv[optind];
+	if (optind + 1 < argc) {
+		src = argv[optind + 1];
+		io = fopen(src, "r");
+		if (!io) {
+			fprintf(stderr, "phash-gen: %s: %s\n", src, strerror(errno));
+			return 1;
+		}
+	}
+
+	if (s_read(io) != 0 || s_dupes() != 0)
+		return 1;
+	if (!N) {
+		fprintf(stderr, "phash-gen: no keys found in %s\n", src);
+		return 1;
+	}
+
+	phash_t ph;
+	uint32_t *disp, tries;
+	uint8_t *taken;
+
+	ph.n  = N;
+	ph.nb = N / 2 + 1;
+	ph.disp = disp = calloc(ph.nb, sizeof(uint32_t));
+	SIZES = calloc(ph.nb, sizeof(uint32_t));
+	taken = calloc(ph.n, 1);
+
+	ph.seed = 0x9e3779b97f4a7c15ull;
+	for (tries = 0; tries < MAX_TRIES; tries++) {
+		if (s_place(&ph, disp, taken) == 0) {
+			s_write(stdout, &ph, name, type, src);
+			return 0;
+		}
+		ph.seed = phash64((const char *)&ph.seed, sizeof(ph.seed), tries);
+	}
+
+	fprintf(stderr, "phash-gen: unable to find a perfect hash for %u keys from %s\n", N, src);
+	return 1;
+}